@@ -0,0 +1,443 @@
+// Douglas Keller
+
+/*	json_bench measures how fast the library parses, prints, exports,
+	filters and copies documents of a few different shapes. Every
+	corpus is generated from a fixed seed, so runs on different
+	machines or releases measure exactly the same input.
+
+	Each result is written as one line of json, so results can be
+	collected and compared by a script:
+		{"corpus": "records", "operation": "parse", "bytes": 4194304,
+		 "nodes": 262144, "seconds": 0.012300000, "mb_per_s": 325.2,
+		 "ns_per_node": 46.9, "allocations": 130, "allocated_bytes": 8912896}
+	The time is the best of all repetitions; the allocation counts
+	are from the last one. They include the blocks documents' arenas
+	take, which come from operator new like everything else.
+
+	The records corpus is also bound straight into structs, as bind.
+
+	copy only shares the document's values, so it takes the same
+	time for any size; materialize is the copy that duplicates them.
+	Filters on 16 and 32 threads are checked to share the document's
+	values, and so is a copy of a document parsed on 32 threads after
+	one element is set; json_bench fails if they copy them instead.
+	Build with -DCMAKE_BUILD_TYPE=Release for numbers worth comparing.
+
+	Options:
+		--size=N     the size of each corpus in megabytes, 4 by default
+		--reps=N     how many times each operation is timed, 5 by default
+		--corpus=X   only run the named corpus
+*/
+
+#include "json.hpp"
+#include "bind.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+using namespace json;
+
+//*****************************
+// Allocation counting
+//*****************************
+
+namespace {
+	atomic<size_t> allocations(0);
+	atomic<size_t> allocated(0);
+}
+
+// Every allocation in the program goes through these, so each
+// operation's allocations can be counted.
+void* operator new(size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	allocated.fetch_add(size, memory_order_relaxed);
+	if(void* p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+void operator delete(void* p) noexcept {
+	free(p);
+}
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+//*****************************
+// Corpus generation
+//*****************************
+
+namespace {
+	// mt19937 gives the same numbers everywhere, which the standard
+	// distributions do not promise, so values are drawn from it directly.
+	class Generator {
+	public:
+		Generator(size_t target) : rng(20240601), target(target) { }
+
+		string wide();
+		string deep();
+		string strings();
+		string numbers();
+		string records();
+
+	private:
+		mt19937 rng;
+		size_t target;
+		string out;
+
+		size_t below(size_t n) { return size_t(rng() % n); }
+		void word(size_t length);
+		void text();
+		void number();
+		void record(size_t id);
+	};
+
+	void Generator::word(size_t length) {
+		for(size_t i = 0; i < length; ++i)
+			out += char('a' + below(26));
+	}
+
+	// A string with the escapes and punctuation real text has.
+	void Generator::text() {
+		static const char* const pieces[] = { "\\\"", "\\\\", "\\n", "\\t", "\\u00e9", " ", ", ", ". " };
+		out += '\"';
+		size_t length = 8 + below(120);
+		for(size_t n = 0; n < length;) {
+			if(below(8) == 0) {
+				string p = pieces[below(sizeof(pieces) / sizeof(pieces[0]))];
+				out += p;
+				n += p.size();
+			} else {
+				out += char('a' + below(26));
+				++n;
+			}
+		}
+		out += '\"';
+	}
+
+	void Generator::number() {
+		switch(below(4)) {
+			case 0: out += to_string(below(100)); break;
+			case 1: out += to_string(int64_t(rng()) - int64_t(1u << 31)); break;
+			case 2: out += to_string(below(100000)) + '.' + to_string(below(1000)); break;
+			default: out += to_string(below(10)) + '.' + to_string(below(100000)) + "e-" + to_string(below(20)); break;
+		}
+	}
+
+	// One object of the kind an array of database rows is made of.
+	void Generator::record(size_t id) {
+		out += "{\"id\": " + to_string(id) + ", \"name\": \"";
+		word(4 + below(8));
+		out += "\", \"active\": ";
+		out += below(2) ? "true" : "false";
+		out += ", \"score\": ";
+		number();
+		out += ", \"tags\": [";
+		for(size_t i = 0, n = below(4); i < n; ++i) {
+			out += i ? ", \"" : "\"";
+			word(3 + below(5));
+			out += '\"';
+		}
+		out += "], \"owner\": {\"id\": " + to_string(below(1000)) + ", \"email\": null}}";
+	}
+
+	// One object with a great many members.
+	string Generator::wide() {
+		out = "{";
+		for(size_t i = 0; out.size() < target; ++i) {
+			out += i ? ", \"" : "\"";
+			word(6);
+			out += to_string(i) + "\": ";
+			if(below(2))
+				number();
+			else
+				text();
+		}
+		out += '}';
+		return move(out);
+	}
+
+	// Arrays of objects of arrays, nested a few hundred levels deep, side by side.
+	string Generator::deep() {
+		out = "[";
+		for(size_t i = 0; out.size() < target; ++i) {
+			out += i ? ", " : "";
+			size_t depth = 100 + below(400);
+			for(size_t d = 0; d < depth; ++d)
+				out += d % 2 ? "{\"id\": " : "[";
+			number();
+			for(size_t d = depth; d-- > 0;)
+				out += d % 2 ? "}" : "]";
+		}
+		out += ']';
+		return move(out);
+	}
+
+	string Generator::strings() {
+		out = "[";
+		for(size_t i = 0; out.size() < target; ++i) {
+			out += i ? ", " : "";
+			text();
+		}
+		out += ']';
+		return move(out);
+	}
+
+	string Generator::numbers() {
+		out = "[";
+		for(size_t i = 0; out.size() < target; ++i) {
+			out += i ? ", " : "";
+			number();
+		}
+		out += ']';
+		return move(out);
+	}
+
+	string Generator::records() {
+		out = "[";
+		for(size_t i = 0; out.size() < target; ++i) {
+			out += i ? ", " : "";
+			record(i);
+		}
+		out += ']';
+		return move(out);
+	}
+
+	// Counts every value in a document, to report time per node.
+	struct Counter final : Handler {
+		size_t nodes;
+		Counter() : nodes(0) { }
+
+		void onObjectBegin() { ++nodes; }
+		void onKey(Slice) { }
+		void onObjectEnd() { }
+		void onArrayBegin() { ++nodes; }
+		void onArrayEnd() { }
+		void onString(Slice) { ++nodes; }
+		void onNumber(Slice) { ++nodes; }
+		void onTrue()  { ++nodes; }
+		void onFalse() { ++nodes; }
+		void onNull()  { ++nodes; }
+	};
+
+	// The shape of each row of the records corpus, for bind.
+	struct Owner {
+		int64_t id;
+		string email;
+	};
+	struct Record {
+		int64_t id;
+		string name;
+		bool active;
+		double score;
+		vector<string> tags;
+		Owner owner;
+	};
+
+	struct Corpus {
+		string name;
+		string text;
+		size_t nodes;
+	};
+}
+
+namespace json {
+	template<> struct Schema<Owner> {
+		static void fields(Fields<Owner>& f) {
+			f.add("id", &Owner::id);
+			f.add("email", &Owner::email);
+		}
+	};
+	template<> struct Schema<Record> {
+		static void fields(Fields<Record>& f) {
+			f.add("id", &Record::id);
+			f.add("name", &Record::name);
+			f.add("active", &Record::active);
+			f.add("score", &Record::score);
+			f.add("tags", &Record::tags);
+			f.add("owner", &Record::owner);
+		}
+	};
+}
+
+namespace {
+//*****************************
+// Measurement
+//*****************************
+
+	// Times run reps times and writes a line of results for it.
+	void measure(Corpus const& c, const char* operation, unsigned reps, function<void()> const& run) {
+		double best = 0;
+		size_t count = 0, bytes = 0;
+		for(unsigned r = 0; r < reps; ++r) {
+			size_t a = allocations.load(), b = allocated.load();
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			run();
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			count = allocations.load() - a;
+			bytes = allocated.load() - b;
+			if(r == 0 || seconds < best)
+				best = seconds;
+		}
+
+		char line[512];
+		snprintf(line, sizeof(line), "{\"corpus\": \"%s\", \"operation\": \"%s\", \"bytes\": %zu, "
+				"\"nodes\": %zu, \"seconds\": %.9f, \"mb_per_s\": %.1f, \"ns_per_node\": %.1f, "
+				"\"allocations\": %zu, \"allocated_bytes\": %zu}",
+				c.name.c_str(), operation, c.text.size(), c.nodes, best,
+				double(c.text.size()) / (1 << 20) / best, best * 1e9 / double(c.nodes), count, bytes);
+		cout << line << endl;
+	}
+
+	// The strings and numbers under v, walked on an explicit stack
+	// since some corpora are nested deeply.
+	vector<Value const*> leaves(Value const* v) {
+		vector<Value const*> found, pending;
+		if(v)
+			pending.push_back(v);
+		while(!pending.empty()) {
+			Value const* next = pending.back();
+			pending.pop_back();
+			if(next->type == Type::Object) {
+				Object const* o = static_cast<Object const*>(next);
+				for(size_t i = 0; i < o->size; ++i)
+					pending.push_back(o->members[i].value);
+			} else if(next->type == Type::Array) {
+				Array const* a = static_cast<Array const*>(next);
+				pending.insert(pending.end(), a->values, a->values + a->size);
+			} else if(next->type == Type::String || next->type == Type::Number) {
+				found.push_back(next);
+			}
+		}
+		return found;
+	}
+
+	// Whether every string and number in result is one of source's
+	// rather than a copy, as it should be for a filter's result.
+	bool shares(Value const* result, Value const* source) {
+		vector<Value const*> kept = leaves(result), all = leaves(source);
+		unordered_set<Value const*> from(all.begin(), all.end());
+		for(Value const* v : kept)
+			if(!from.count(v))
+				return false;
+		return true;
+	}
+
+	// Results are kept somewhere the compiler cannot see through,
+	// so the work that produced them is not optimized away.
+	volatile size_t sink;
+}
+
+int main(int argc, char** argv) {
+	size_t megabytes = 4;
+	unsigned reps = 5;
+	string only;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg.compare(0, 7, "--size=") == 0)
+			megabytes = size_t(atoi(arg.c_str() + 7));
+		else if(arg.compare(0, 7, "--reps=") == 0)
+			reps = unsigned(atoi(arg.c_str() + 7));
+		else if(arg.compare(0, 9, "--corpus=") == 0)
+			only = arg.substr(9);
+		else {
+			cerr << "Unknown option " << arg << endl;
+			return 1;
+		}
+	}
+	if(reps == 0)
+		reps = 1;
+
+	vector<Corpus> corpora;
+	const char* names[] = { "wide", "deep", "strings", "numbers", "records" };
+	for(const char* name : names) {
+		if(!only.empty() && only != name)
+			continue;
+		Corpus c;
+		c.name = name;
+		string n = name;
+		Generator g(megabytes << 20);	// A fresh one for each, so --corpus does not change the input.
+		c.text = n == "wide" ? g.wide() : n == "deep" ? g.deep() : n == "strings" ? g.strings()
+				: n == "numbers" ? g.numbers() : g.records();
+		Counter counter;
+		parse(c.text.data(), c.text.size(), counter);
+		c.nodes = counter.nodes;
+		corpora.push_back(move(c));
+	}
+
+	// Keys every corpus has somewhere, so filter has something to keep.
+	vector<string> keys = { "id", "score" };
+
+	for(Corpus const& c : corpora) {
+		measure(c, "parse", reps, [&] {
+			istringstream in(c.text);
+			Document d(in);
+			sink = d.root() != nullptr;
+		});
+
+		istringstream in(c.text);
+		Document d(in);
+
+		// Changing one element of a copy of a document parsed on many
+		// threads must leave every other element shared.
+		Document parallel = Document::parseParallel(c.text.data(), c.text.size(), 32);
+		if(parallel.root()->type == Type::Array) {
+			Document changed = parallel;
+			changed.set({ "0" }, Document(string("0")));
+			Array const* before = static_cast<Array const*>(parallel.root());
+			Array const* after = static_cast<Array const*>(changed.root());
+			if(!equal(before->values + 1, before->values + before->size, after->values + 1)) {
+				cerr << "set on a copy of " << c.name << " parsed on 32 threads copied its elements" << endl;
+				return 1;
+			}
+		}
+		measure(c, "print", reps, [&] {
+			ostringstream out;
+			d.print(out);
+			sink = out.tellp();
+		});
+		measure(c, "output", reps, [&] {
+			sink = d.output().size();
+		});
+		measure(c, "filter", reps, [&] {
+			Document f = d.filter(keys);
+			sink = f.root() != nullptr;
+		});
+		// Filtering on many threads must still share the document's
+		// values, however many storages the threads made.
+		for(unsigned threads : { 16u, 32u }) {
+			Document f = d.filter(keys, threads);
+			if(!shares(f.root(), d.root())) {
+				cerr << "filter on " << threads << " threads copied the values of " << c.name << endl;
+				return 1;
+			}
+		}
+		measure(c, "copy", reps, [&] {
+			Document copy = d.copy();
+			sink = copy.root() != nullptr;
+		});
+		measure(c, "materialize", reps, [&] {
+			Document copy = d.materialize();
+			sink = copy.root() != nullptr;
+		});
+		if(c.name == "records")
+			measure(c, "bind", reps, [&] {
+				vector<Record> rows;
+				json::bind(c.text.data(), c.text.size(), rows);
+				sink = rows.size();
+			});
+	}
+}
@@ -0,0 +1,283 @@
+// Douglas Keller
+
+#include "bind.hpp"
+#include "reader.hpp"
+#include <stdexcept>
+
+const json::Binding json::Bindings<bool>::binding = {
+	"expected true or false", nullptr, nullptr, &Bindings<bool>::boolean, nullptr, nullptr, nullptr
+};
+const json::Binding json::Bindings<std::string>::binding = {
+	"expected a string", &Bindings<std::string>::string, nullptr, nullptr, nullptr, nullptr, nullptr
+};
+const json::Binding json::Bindings<std::vector<bool> >::binding = {
+	"expected an array", nullptr, nullptr, nullptr, &Bindings<std::vector<bool> >::clear, nullptr, &Bindings<std::vector<bool> >::element
+};
+const json::Binding json::Bindings<std::vector<bool> >::last = {
+	"expected true or false", nullptr, nullptr, &Bindings<std::vector<bool> >::boolean, nullptr, nullptr, nullptr
+};
+
+namespace {
+	// Packs a key's length and up to eight characters from each end into a
+	// word, which tells apart the keys of nearly every struct there is.
+	std::uint64_t ends(json::Slice key) {
+		std::uint64_t first = 0, last = 0;
+		std::memcpy(&first, key.data, key.size < 8 ? key.size : 8);
+		if(key.size > 8)
+			std::memcpy(&last, key.data + key.size - 8, 8);
+		return first ^ (last * 0x9e3779b97f4a7c15ull) ^ (std::uint64_t(key.size) << 59);
+	}
+
+	/*	The Binder is the Handler that fills in a bound value as it is
+		read. frames holds each object and array being filled in, and
+		next is where the value of the member whose key was just read
+		goes. Everything inside a value that is not bound, like the
+		value of an unknown key, is skipped by counting its depth.
+	*/
+	struct Binder final : json::Handler {
+		std::vector<json::Target> frames;
+		json::Target next;
+		std::size_t skipping;	// Objects and arrays open inside a skipped value.
+		std::string key;		// A key with escapes in it, unescaped.
+
+		Binder(json::Target root) : next(root), skipping(0) { }
+
+		// Where the value being read goes.
+		json::Target target() {
+			if(!frames.empty() && frames.back().binding->element)
+				return frames.back().binding->element(frames.back().object);
+			return next;
+		}
+		// Where a string, number or literal goes, which has no binding if it is skipped.
+		json::Target leaf() {
+			if(skipping) {
+				json::Target t = { nullptr, nullptr };
+				return t;
+			}
+			return target();
+		}
+		static void wrong(json::Target t) { throw json::BindError(t.binding->expected); }
+
+		// Begins an object or array, which the binding must take.
+		void begin(bool object) {
+			if(skipping) {
+				++skipping;
+				return;
+			}
+			json::Target t = target();
+			if(!t.binding) {
+				skipping = 1;
+				return;
+			}
+			if(object ? !t.binding->field : !t.binding->element)
+				wrong(t);
+			if(t.binding->clear)
+				t.binding->clear(t.object);
+			frames.push_back(t);
+		}
+		void end() {
+			if(skipping)
+				--skipping;
+			else
+				frames.pop_back();
+		}
+
+		void onObjectBegin() { begin(true); }
+		void onArrayBegin() { begin(false); }
+		void onObjectEnd() { end(); }
+		void onArrayEnd() { end(); }
+
+		void onKey(json::Slice k) {
+			if(skipping)
+				return;
+			if(std::memchr(k.data, '\\', k.size)) {
+				key.clear();
+				json::unescape(k, key);
+				k.data = key.data();
+				k.size = key.size();
+			}
+			next = frames.back().binding->field(frames.back().object, k);
+		}
+		void onString(json::Slice s) {
+			json::Target t = leaf();
+			if(!t.binding)
+				return;
+			if(!t.binding->string)
+				wrong(t);
+			t.binding->string(t.object, s);
+		}
+		void onNumber(json::Slice s) {
+			json::Target t = leaf();
+			if(!t.binding)
+				return;
+			if(!t.binding->number)
+				wrong(t);
+			t.binding->number(t.object, s);
+		}
+		void boolean(bool b) {
+			json::Target t = leaf();
+			if(!t.binding)
+				return;
+			if(!t.binding->boolean)
+				wrong(t);
+			t.binding->boolean(t.object, b);
+		}
+		void onTrue() { boolean(true); }
+		void onFalse() { boolean(false); }
+		// A null leaves a member as it was, but still takes up an element of a vector.
+		void onNull() { leaf(); }
+	};
+
+	void utf8(std::uint32_t c, std::string& out) {
+		if(c < 0x80) {
+			out += char(c);
+		} else if(c < 0x800) {
+			out += char(0xc0 | (c >> 6));
+			out += char(0x80 | (c & 0x3f));
+		} else if(c < 0x10000) {
+			out += char(0xe0 | (c >> 12));
+			out += char(0x80 | ((c >> 6) & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		} else {
+			out += char(0xf0 | (c >> 18));
+			out += char(0x80 | ((c >> 12) & 0x3f));
+			out += char(0x80 | ((c >> 6) & 0x3f));
+			out += char(0x80 | (c & 0x3f));
+		}
+	}
+
+	// Reads the four hex digits of a \u escape at p.
+	std::uint32_t hex(const char* p, const char* end) {
+		if(end - p < 4)
+			throw json::ParseError("invalid escape");
+		std::uint32_t c = 0;
+		for(int i = 0; i < 4; ++i) {
+			char d = p[i];
+			c <<= 4;
+			if(d >= '0' && d <= '9')
+				c |= std::uint32_t(d - '0');
+			else if(d >= 'a' && d <= 'f')
+				c |= std::uint32_t(d - 'a' + 10);
+			else if(d >= 'A' && d <= 'F')
+				c |= std::uint32_t(d - 'A' + 10);
+			else
+				throw json::ParseError("invalid escape");
+		}
+		return c;
+	}
+}
+
+//*****************************
+// FieldTable member functions
+//*****************************
+
+void json::FieldTable::add(Field const& f) {
+	fields.push_back(f);
+}
+
+std::size_t json::FieldTable::slot(Slice key, std::uint64_t s, unsigned sh) const {
+	std::uint64_t h = whole ? key.hash() : ends(key);
+	return sh == 64 ? 0 : std::size_t(((h ^ s) * 0xbf58476d1ce4e5b9ull) >> sh);
+}
+
+/*	Tries seeds on a table twice as big as the fields until one puts
+	every field in a slot of its own, and doubles the table when a few
+	hundred seeds have not. Keys the ends of cannot tell apart are
+	hashed whole instead.
+*/
+void json::FieldTable::seal() {
+	for(std::size_t i = 0; i < fields.size(); ++i)
+		for(std::size_t j = 0; j < i; ++j)
+			if(fields[i].name == fields[j].name)
+				throw std::logic_error("the field " + fields[i].name + " is bound twice");
+	if(fields.empty())
+		return;
+
+	for(int pass = 0; pass < 2; ++pass, whole = true) {
+		unsigned sh = 64;
+		while(std::size_t(1) << (64 - sh) < 2 * fields.size())
+			--sh;
+		for(int doubled = 0; doubled < 4; ++doubled, --sh) {
+			for(std::uint64_t s = 1; s <= 256; ++s) {
+				slots.assign(std::size_t(1) << (64 - sh), -1);
+				std::size_t i = 0;
+				for(; i < fields.size(); ++i) {
+					Slice name = { fields[i].name.data(), fields[i].name.size() };
+					int& to = slots[slot(name, s * 0x9e3779b97f4a7c15ull, sh)];
+					if(to >= 0)
+						break;
+					to = int(i);
+				}
+				if(i == fields.size()) {
+					seed = s * 0x9e3779b97f4a7c15ull;
+					shift = sh;
+					return;
+				}
+			}
+		}
+	}
+	throw std::logic_error("no perfect hash for the fields");
+}
+
+json::FieldTable::Field const* json::FieldTable::find(Slice key) const {
+	if(slots.empty())
+		return nullptr;
+	int i = slots[slot(key, seed, shift)];
+	if(i < 0 || !(key == fields[i].name))
+		return nullptr;
+	return &fields[i];
+}
+
+//*****************************
+// Binding functions
+//*****************************
+
+//Precondition:  s is the inside of a json string, as it was written.
+void json::unescape(Slice s, std::string& out) {
+	const char* p = s.data;
+	const char* end = s.data + s.size;
+	while(p != end) {
+		const char* slash = static_cast<const char*>(std::memchr(p, '\\', std::size_t(end - p)));
+		if(!slash) {
+			out.append(p, end);
+			return;
+		}
+		out.append(p, slash);
+		p = slash + 1;
+		if(p == end)
+			throw ParseError("invalid escape");
+		switch(*p++) {
+			case '\"': out += '\"'; break;
+			case '\\': out += '\\'; break;
+			case '/':  out += '/';  break;
+			case 'b':  out += '\b'; break;
+			case 'f':  out += '\f'; break;
+			case 'n':  out += '\n'; break;
+			case 'r':  out += '\r'; break;
+			case 't':  out += '\t'; break;
+			case 'u': {
+				std::uint32_t c = hex(p, end);
+				p += 4;
+				// A high surrogate followed by a low one is a single character.
+				if(c >= 0xd800 && c < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+					std::uint32_t low = hex(p + 2, end);
+					if(low >= 0xdc00 && low < 0xe000) {
+						c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+						p += 6;
+					}
+				}
+				utf8(c, out);
+				break;
+			}
+			default:
+				throw ParseError("invalid escape");
+		}
+	}
+}
+
+void json::bindTarget(const char* data, std::size_t size, Target t) {
+	Binder b(t);
+	Reader<Binder> r(data, size, b);
+	r.read();
+	r.finish();
+}
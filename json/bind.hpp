@@ -0,0 +1,289 @@
+// Douglas Keller
+
+#ifndef BIND_HPP
+#define BIND_HPP
+
+#include "json.hpp"
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace json {
+
+	/*	Binding reads json straight into C++ structs whose layout is known
+		ahead of time, without building a Document or allocating a single
+		Value. A struct is made bindable by specializing Schema for it,
+		naming each member and the key it is read from:
+
+			struct Trade {
+				std::string symbol;
+				double price;
+				std::vector<std::int64_t> fills;
+			};
+			namespace json {
+				template<> struct Schema<Trade> {
+					static void fields(Fields<Trade>& f) {
+						f.add("symbol", &Trade::symbol);
+						f.add("price", &Trade::price);
+						f.add("fills", &Trade::fills);
+					}
+				};
+			}
+
+			Trade t;
+			json::bind(data, size, t);
+
+		Members can be bool, any integer or floating point type,
+		std::string, std::vector of a bindable type, or another struct
+		with a Schema. The code that fills each type in is made by the
+		templates below for that type, and the keys of a struct are
+		looked up in a perfect hash table made from its Schema the first
+		time it is bound, so each key costs one probe and one compare.
+
+		The parser itself is not made anew for each type. The templates
+		make a table of functions for each type, a Binding, and one
+		Reader calls through those tables for every bound type. The
+		perfect hash's seed is searched for at run time, since a Schema
+		names its keys in code that runs rather than in a constant
+		expression the compiler could hash. A call through a table costs
+		far less than the Values and Document it replaces, and every
+		bound type shares one copy of the parser.
+
+		Keys that a struct does not name are skipped, along with their
+		values, and members whose keys are missing or null keep the value
+		they had. An array replaces what was in a vector.
+		bind throws ParseError if the input is not a json value or has
+		anything but whitespace after it, BindError if it does not have
+		the shape of T, and std::range_error if a number does not fit in
+		its member, as Number's accessors do.
+	*/
+	template<class T> struct Schema;
+
+	// Thrown when json does not have the shape of the type it is bound to.
+	struct BindError : ParseError {
+		BindError(const char* what) : ParseError(what) { }
+	};
+
+	struct Binding;
+
+	// Where a value is to be bound: an object and how to fill it in.
+	// binding is nullptr for a value that is to be skipped.
+	struct Target {
+		void* object;
+		Binding const* binding;
+	};
+
+	/*	How values of one C++ type are filled in from parser events.
+		Events a type cannot take are nullptr, and throw BindError
+		naming what was expected instead.
+	*/
+	struct Binding {
+		const char* expected;				// The error for a value of the wrong kind.
+		void (*string)(void*, Slice);		// Takes the string as it was written.
+		void (*number)(void*, Slice);
+		void (*boolean)(void*, bool);
+		void (*clear)(void*);				// Called as an object or array is begun.
+		Target (*field)(void*, Slice);		// For objects, where the member with the key goes.
+		Target (*element)(void*);			// For arrays, where the next element goes.
+	};
+
+	/*	The members a Schema names, in the order they were added.
+		Once it is complete, seal finds a seed that sends every name to
+		a slot of its own, so looking a key up is one hash and one
+		compare of the name in that slot.
+	*/
+	class FieldTable {
+	public:
+		struct Field {
+			std::string name;
+			Binding const* binding;
+			void* (*locate)(void*, Field const&);	// The member of an object.
+			unsigned char member[2 * sizeof(void*)];	// The pointer to member, for locate.
+		};
+
+		FieldTable() : seed(0), shift(64), whole(false) { }
+
+		void add(Field const&);
+		// Throws std::logic_error if two fields have the same name.
+		void seal();
+		Field const* find(Slice key) const;
+
+	private:
+		std::vector<Field> fields;
+		std::vector<int> slots;	// The index of the field in each slot, or -1.
+		std::uint64_t seed;
+		unsigned shift;			// 64 less the log of the number of slots.
+		bool whole;				// Hash every character, not just the ends.
+
+		std::size_t slot(Slice key, std::uint64_t s, unsigned sh) const;
+	};
+
+	template<class T> class Fields {
+	public:
+		template<class M> void add(const char* name, M T::* member);
+
+	private:
+		template<class U, class E> friend struct Bindings;
+		FieldTable table;
+	};
+
+	// Writes the characters of a string as written in json into out,
+	// with its escape sequences replaced by what they stand for.
+	void unescape(Slice, std::string& out);
+
+	// Binds the value in data to the target. Called by bind.
+	void bindTarget(const char* data, std::size_t size, Target);
+
+	//*****************************
+	// The bindings of each type
+	//*****************************
+
+	// Structs with a Schema.
+	template<class T, class Enable = void> struct Bindings {
+		static const Binding binding;
+
+		static FieldTable const& table() {
+			static FieldTable const t = make();	// Made once, safely, by the first thread to bind a T.
+			return t;
+		}
+		static FieldTable make() {
+			Fields<T> f;
+			Schema<T>::fields(f);
+			f.table.seal();
+			return f.table;
+		}
+		static Target field(void* object, Slice key) {
+			Target t = { nullptr, nullptr };
+			if(FieldTable::Field const* f = table().find(key)) {
+				t.object = f->locate(object, *f);
+				t.binding = f->binding;
+			}
+			return t;
+		}
+	};
+	template<class T, class E> const Binding Bindings<T, E>::binding = {
+		"expected an object", nullptr, nullptr, nullptr, nullptr, &Bindings<T, E>::field, nullptr
+	};
+
+	template<> struct Bindings<bool> {
+		static const Binding binding;
+		static void boolean(void* object, bool b) { *static_cast<bool*>(object) = b; }
+	};
+
+	// Every integer type but bool.
+	template<class T> struct Bindings<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+		static const Binding binding;
+
+		static void number(void* object, Slice s) {
+			Number n;
+			n.value = s;
+			if(std::is_signed<T>::value) {
+				std::int64_t i = n.asInt64();
+				if(i < std::int64_t(std::numeric_limits<T>::min()) || i > std::int64_t(std::numeric_limits<T>::max()))
+					throw std::range_error("number out of range");
+				*static_cast<T*>(object) = T(i);
+			} else {
+				std::uint64_t u = n.asUint64();
+				if(u > std::uint64_t(std::numeric_limits<T>::max()))
+					throw std::range_error("number out of range");
+				*static_cast<T*>(object) = T(u);
+			}
+		}
+	};
+	template<class T> const Binding Bindings<T, typename std::enable_if<std::is_integral<T>::value>::type>::binding = {
+		"expected a number", nullptr, &number, nullptr, nullptr, nullptr, nullptr
+	};
+
+	template<class T> struct Bindings<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+		static const Binding binding;
+
+		static void number(void* object, Slice s) {
+			Number n;
+			n.value = s;
+			*static_cast<T*>(object) = T(n.asDouble());
+		}
+	};
+	template<class T> const Binding Bindings<T, typename std::enable_if<std::is_floating_point<T>::value>::type>::binding = {
+		"expected a number", nullptr, &number, nullptr, nullptr, nullptr, nullptr
+	};
+
+	template<> struct Bindings<std::string> {
+		static const Binding binding;
+		static void string(void* object, Slice s) {
+			std::string& out = *static_cast<std::string*>(object);
+			out.clear();
+			unescape(s, out);
+		}
+	};
+
+	template<class T> struct Bindings<std::vector<T> > {
+		static const Binding binding;
+
+		static void clear(void* object) { static_cast<std::vector<T>*>(object)->clear(); }
+		// Elements are bound one at a time, so only the last is ever being
+		// filled in when the vector grows.
+		static Target element(void* object) {
+			std::vector<T>& v = *static_cast<std::vector<T>*>(object);
+			v.emplace_back();
+			Target t = { &v.back(), &Bindings<T>::binding };
+			return t;
+		}
+	};
+	template<class T> const Binding Bindings<std::vector<T> >::binding = {
+		"expected an array", nullptr, nullptr, nullptr, &clear, nullptr, &element
+	};
+
+	// std::vector<bool> packs its elements into bits, which cannot be
+	// pointed to, so each element is added as false and the binding of
+	// the last element sets it through the vector.
+	template<> struct Bindings<std::vector<bool> > {
+		static const Binding binding;
+		static const Binding last;	// The element just added.
+
+		static void clear(void* object) { static_cast<std::vector<bool>*>(object)->clear(); }
+		static void boolean(void* object, bool b) { static_cast<std::vector<bool>*>(object)->back() = b; }
+		static Target element(void* object) {
+			static_cast<std::vector<bool>*>(object)->push_back(false);
+			Target t = { object, &last };
+			return t;
+		}
+	};
+
+	//*****************************
+	// Function templates
+	//*****************************
+
+	template<class T> template<class M>
+	void Fields<T>::add(const char* name, M T::* member) {
+		static_assert(sizeof(member) <= sizeof(FieldTable::Field::member), "pointer to member too large");
+		struct Locate {
+			static void* member(void* object, FieldTable::Field const& f) {
+				M T::* m;
+				std::memcpy(&m, f.member, sizeof(m));
+				return &(static_cast<T*>(object)->*m);
+			}
+		};
+		FieldTable::Field f;
+		f.name = name;
+		f.binding = &Bindings<M>::binding;
+		f.locate = &Locate::member;
+		std::memcpy(f.member, &member, sizeof(member));
+		table.add(f);
+	}
+
+	//Precondition:  data points to size readable characters.
+	//Postcondition: out holds the value in data.
+	template<class T> void bind(const char* data, std::size_t size, T& out) {
+		Target t = { &out, &Bindings<T>::binding };
+		bindTarget(data, size, t);
+	}
+	template<class T> T bind(const char* data, std::size_t size) {
+		T out = T();
+		bind(data, size, out);
+		return out;
+	}
+};
+
+#endif
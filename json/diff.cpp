@@ -0,0 +1,395 @@
+// Douglas Keller
+
+#include "json.hpp"
+#include "tape.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+	using json::Value;
+	using json::Type;
+
+	// Scrambles the bits of x, so similar inputs give unrelated hashes.
+	std::uint64_t mix(std::uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	// The hash of a string, number or literal with the given text.
+	std::uint64_t leaf(Type t, json::Slice text) {
+		switch(t) {
+			case Type::String: return mix(text.hash() ^ 0x5354524eull);
+			case Type::Number: return mix(text.hash() ^ 0x4e554d42ull);
+			default:           return mix(std::uint64_t(t) + 1);
+		}
+	}
+
+	// The hash of an object or array, from the sum of its members'
+	// or elements' hashes and how many there are.
+	std::uint64_t container(std::uint64_t sum, std::size_t size, bool object) {
+		std::uint64_t h = mix(sum ^ (std::uint64_t(size) << 8) ^ (object ? 0x7b : 0x5b));
+		return h ? h : 1;	// 0 means the hash is not known yet.
+	}
+	// Adds a member's or element's hash to the sum of its container.
+	// Adding the members' hashes makes their order not matter.
+	std::uint64_t add(std::uint64_t sum, std::uint64_t h, json::Slice const* key) {
+		return key ? sum + mix(key->hash() ^ mix(h)) : mix(sum + h);
+	}
+
+	// Finds the hash of a string, number or literal, or of an object or
+	// array whose hash has already been worked out.
+	// Postcondition: Returns false if the hash is not known yet.
+	bool known(Value const* v, std::uint64_t& h) {
+		switch(v->type) {
+			case Type::Object:
+				h = static_cast<json::Object const*>(v)->digest.load(std::memory_order_relaxed);
+				return h != 0;
+			case Type::Array:
+				h = static_cast<json::Array const*>(v)->digest.load(std::memory_order_relaxed);
+				return h != 0;
+			case Type::String:
+				h = leaf(v->type, static_cast<json::String const*>(v)->value);
+				return true;
+			case Type::Number:
+				h = leaf(v->type, static_cast<json::Number const*>(v)->value);
+				return true;
+			default:
+				h = leaf(v->type, json::Slice());
+				return true;
+		}
+	}
+
+	// How many values same compares one by one before it trusts the
+	// hashes of whatever is left below.
+	const std::size_t compareBudget = 64;
+
+	// Whether a and b, whose hashes match, really are equal. Strings
+	// and numbers are compared by text, and objects and arrays member
+	// by member until budget values have been looked at; below that,
+	// values are taken to be equal when their hashes are. So a hash
+	// collision can never hide a change to a small value, and checking
+	// a large one costs no more than budget values.
+	bool equal(Value const* a, Value const* b, std::size_t& budget) {
+		if(a == b)
+			return true;
+		if(a->type != b->type)
+			return false;
+		if(budget == 0)
+			return json::structuralHash(a) == json::structuralHash(b);
+		--budget;
+		switch(a->type) {
+			case Type::String:
+				return static_cast<json::String const*>(a)->value == static_cast<json::String const*>(b)->value;
+			case Type::Number:
+				return static_cast<json::Number const*>(a)->value == static_cast<json::Number const*>(b)->value;
+			case Type::Object: {
+				json::Object const* oa = static_cast<json::Object const*>(a);
+				json::Object const* ob = static_cast<json::Object const*>(b);
+				if(oa->size != ob->size)
+					return false;
+				for(std::size_t i = 0; i < oa->size; ++i) {
+					Value const* other = ob->find(oa->members[i].key->text);
+					if(!other || !equal(oa->members[i].value, other, budget))
+						return false;
+				}
+				return true;
+			}
+			case Type::Array: {
+				json::Array const* aa = static_cast<json::Array const*>(a);
+				json::Array const* ab = static_cast<json::Array const*>(b);
+				if(aa->size != ab->size)
+					return false;
+				for(std::size_t i = 0; i < aa->size; ++i)
+					if(!equal(aa->values[i], ab->values[i], budget))
+						return false;
+				return true;
+			}
+			default:
+				return true;	// Literals of the same type.
+		}
+	}
+
+	// A value is the same as another if it is the same value, or if
+	// both have the same type and hash and equal confirms it.
+	bool same(Value const* a, Value const* b) {
+		if(a == b)
+			return true;
+		if(a->type != b->type || json::structuralHash(a) != json::structuralHash(b))
+			return false;
+		std::size_t budget = compareBudget;
+		return equal(a, b, budget);
+	}
+
+	// The tape tag of each kind of value, as the Type it is in a tree.
+	Type typeOf(json::Tag t) {
+		switch(t) {
+			case json::Tag::String: return Type::String;
+			case json::Tag::Number: return Type::Number;
+			case json::Tag::True:   return Type::True;
+			case json::Tag::False:  return Type::False;
+			default:                return Type::Null;
+		}
+	}
+
+	// Hashes the value at root on its tape straight from its words,
+	// the same as structuralHash would hash it as a tree. Open objects
+	// and arrays are kept on a stack, and each one's hash is added to
+	// its container's as soon as it ends.
+	std::uint64_t tapeHash(json::Cursor root) {
+		struct Frame {
+			json::Iterator at;
+			json::Iterator end;
+			bool object;
+			std::size_t size;
+			std::uint64_t sum;
+			json::Slice key;	// The key of the member being hashed, for objects.
+		};
+		std::vector<Frame> frames;
+		json::Cursor c = root;
+		for(;;) {
+			std::uint64_t h;
+			json::Tag t = c.type();
+			bool ended = true;
+			if(t == json::Tag::Object || t == json::Tag::Array) {
+				Frame f = { c.begin(), c.end(), t == json::Tag::Object, 0, 0, json::Slice() };
+				frames.push_back(f);
+				ended = false;
+			} else {
+				h = leaf(typeOf(t), t == json::Tag::String || t == json::Tag::Number ? c.text() : json::Slice());
+			}
+
+			// Add what has ended to its container, ending containers on the way.
+			for(;;) {
+				if(ended) {
+					if(frames.empty())
+						return h;
+					Frame& parent = frames.back();
+					parent.sum = add(parent.sum, h, parent.object ? &parent.key : nullptr);
+					++parent.size;
+				}
+				Frame& f = frames.back();
+				if(f.at != f.end) {
+					if(f.object)
+						f.key = f.at.key();
+					c = *f.at;
+					++f.at;
+					break;
+				}
+				h = container(f.sum, f.size, f.object);
+				frames.pop_back();
+				ended = true;
+			}
+		}
+	}
+
+	// Adds a key to a JSON Pointer, escaping the characters it uses itself.
+	void append(std::string& path, json::Slice key) {
+		path += '/';
+		for(std::size_t i = 0; i < key.size; ++i) {
+			if(key.data[i] == '~')
+				path += "~0";
+			else if(key.data[i] == '/')
+				path += "~1";
+			else
+				path += key.data[i];
+		}
+	}
+
+	/*	The Differ walks two values side by side and writes an operation
+		for every place they differ into the storage of the patch. The
+		path of the place being compared is kept in a single string that
+		grows and shrinks as the walk goes in and out.
+	*/
+	struct Differ {
+		json::Storage& store;
+		std::vector<Value*> ops;
+		std::string path;
+
+		Differ(json::Storage& s) : store(s) { }
+
+		json::Key const* key(const char* k) {
+			json::Slice s = { k, std::strlen(k) };
+			return store.keys.intern(store.arena, s);
+		}
+		Value* text(const char* data, std::size_t size) {
+			json::Slice s = { data, size };
+			return json::String::make(store.arena, s);
+		}
+
+		// Adds {"op": op, "path": path, "value": value}, without a value if it is null.
+		void change(const char* op, Value* value) {
+			json::Member m[3];
+			m[0].key = key("op");
+			m[0].value = text(op, std::strlen(op));
+			m[1].key = key("path");
+			m[1].value = text(path.data(), path.size());
+			m[2].key = key("value");
+			m[2].value = value;
+			json::Object* o = store.arena.create<json::Object>();
+			o->assign(store.arena, m, value ? 3 : 2);
+			ops.push_back(o);
+		}
+
+		void walk(Value* a, Value* b);
+		void objects(json::Object* a, json::Object* b);
+		void arrays(json::Array* a, json::Array* b);
+	};
+
+	// Recursive method that adds the changes from a to b.
+	void Differ::walk(Value* a, Value* b) {
+		if(same(a, b))
+			return;
+		if(a->type == Type::Object && b->type == Type::Object)
+			objects(static_cast<json::Object*>(a), static_cast<json::Object*>(b));
+		else if(a->type == Type::Array && b->type == Type::Array)
+			arrays(static_cast<json::Array*>(a), static_cast<json::Array*>(b));
+		else
+			change("replace", b);
+	}
+
+	// Members are matched up by key, so their order does not matter.
+	void Differ::objects(json::Object* a, json::Object* b) {
+		std::size_t length = path.size();
+		for(std::size_t i = 0; i < a->size; ++i) {
+			json::Member& m = a->members[i];
+			append(path, m.key->text);
+			if(Value* other = b->find(m.key->text))
+				walk(m.value, other);
+			else
+				change("remove", nullptr);
+			path.resize(length);
+		}
+		for(std::size_t i = 0; i < b->size; ++i) {
+			json::Member& m = b->members[i];
+			if(a->find(m.key->text))
+				continue;
+			append(path, m.key->text);
+			change("add", m.value);
+			path.resize(length);
+		}
+	}
+
+	// Elements that are the same at the start and at the end of both
+	// arrays are skipped; those in between are compared by position,
+	// and what is left over of either array is added or removed.
+	void Differ::arrays(json::Array* a, json::Array* b) {
+		std::size_t first = 0;
+		while(first < a->size && first < b->size && same(a->values[first], b->values[first]))
+			++first;
+		std::size_t endA = a->size, endB = b->size;
+		while(endA > first && endB > first && same(a->values[endA - 1], b->values[endB - 1]))
+			--endA, --endB;
+
+		std::size_t length = path.size();
+		std::size_t i = first;
+		for(; i < endA && i < endB; ++i) {
+			path += '/';
+			path += std::to_string(i);
+			walk(a->values[i], b->values[i]);
+			path.resize(length);
+		}
+		// Each removal moves the elements after it down, so every one
+		// of them removes the element now at position i.
+		for(std::size_t j = i; j < endA; ++j) {
+			path += '/';
+			path += std::to_string(i);
+			change("remove", nullptr);
+			path.resize(length);
+		}
+		for(std::size_t j = i; j < endB; ++j) {
+			path += '/';
+			path += std::to_string(j);
+			change("add", b->values[j]);
+			path.resize(length);
+		}
+	}
+}
+
+// Hashes are worked out on an explicit stack, deepest values first,
+// and each object or array's hash is kept as soon as it is known.
+std::uint64_t json::structuralHash(Value const* root) {
+	std::uint64_t h;
+	if(known(root, h))
+		return h;
+
+	struct Frame {
+		Value const* value;
+		std::size_t next;
+		std::uint64_t sum;
+	};
+	std::vector<Frame> frames;
+	Frame top = { root, 0, 0 };
+	frames.push_back(top);
+	for(;;) {
+		Frame& f = frames.back();
+		bool object = f.value->type == Type::Object;
+		Object const* o = object ? static_cast<Object const*>(f.value) : nullptr;
+		Array const* a = object ? nullptr : static_cast<Array const*>(f.value);
+		std::size_t size = object ? o->size : a->size;
+
+		if(f.next < size) {
+			Value const* child = object ? o->members[f.next].value : a->values[f.next];
+			if(!known(child, h)) {	// Hash the child first, then come back to it.
+				Frame next = { child, 0, 0 };
+				frames.push_back(next);
+				continue;
+			}
+			f.sum = add(f.sum, h, object ? &o->members[f.next].key->text : nullptr);
+			++f.next;
+			continue;
+		}
+
+		h = container(f.sum, size, object);
+		if(object)
+			o->digest.store(h, std::memory_order_relaxed);
+		else
+			a->digest.store(h, std::memory_order_relaxed);
+		frames.pop_back();
+		if(frames.empty())
+			return h;
+	}
+}
+
+//*****************************
+// Document member functions
+//*****************************
+
+std::uint64_t json::Document::hash() const {
+	if(flat)	// Tapes are hashed from their words rather than turned into trees.
+		return tapeHash(flat->root());
+	return head ? structuralHash(head) : 0;
+}
+
+json::Document json::Document::diff(Document const& to) const {
+	// Tapes are compared as trees.
+	if(flat || to.flat) {
+		Document a(*this), b(to);
+		a.unflatten();
+		b.unflatten();
+		return a.diff(b);
+	}
+
+	Document d;
+	Differ differ(*d.store);
+	if(head && to.head)
+		differ.walk(head, to.head);
+	else if(to.head)
+		differ.change("add", to.head);
+	else if(head)
+		differ.change("remove", nullptr);
+
+	Array* ops = d.store->arena.create<Array>();
+	ops->size = differ.ops.size();
+	ops->values = d.store->arena.allocateArray<Value*>(ops->size);
+	std::copy(differ.ops.begin(), differ.ops.end(), ops->values);
+	d.head = ops;
+	if(to.head && to.store)	// Added and replaced values are to's; a moved-from to has no storage.
+		d.keep(to.store);
+	return d;
+}
@@ -1,438 +1,1585 @@
 // Douglas Keller
 
 #include "json.hpp"
+#include "reader.hpp"
+#include "writer.hpp"
+#include "tape.hpp"
+#include "pool.hpp"
+#include "stats.hpp"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//*****************************
+// Arena member functions
+//*****************************
+
+// Blocks start small so tiny documents stay cheap, and double
+// in size up to a limit so large documents need few of them.
+namespace {
+	const std::size_t minBlockSize = 4096;
+	const std::size_t maxBlockSize = 1 << 20;
+
+}
+
+//Precondition:  align is a power of two, and the current block
+//			cannot hold size bytes aligned to align.
+//Postcondition: Returns size bytes of storage aligned to align,
+//			which remain valid until the arena is released.
+void* json::Arena::allocateSlow(std::size_t size, std::size_t align) {
+	grow(size + align);
+	std::size_t pad = (align - reinterpret_cast<std::uintptr_t>(cur) % align) % align;
+	char* p = cur + pad;
+	cur = p + size;
+	used += size;
+	return p;
+}
+
+// Chains a new block onto the arena that can hold at least
+// the given number of bytes after the block header.
+// Blocks come from operator new rather than malloc, so a program
+// that replaces it, like json_bench, sees every block allocated.
+void json::Arena::grow(std::size_t size) {
+	std::size_t blockSize = blocks ? 2 * std::size_t(end - reinterpret_cast<char*>(blocks)) : minBlockSize;
+	if(blockSize > maxBlockSize)
+		blockSize = maxBlockSize;
+	if(blockSize < size + sizeof(Block))
+		blockSize = size + sizeof(Block);	// Oversized requests get a block of their own.
+
+	Block* b = static_cast<Block*>(::operator new(blockSize));
+	countAllocation();
+	b->next = blocks;
+	blocks = b;
+	cur = reinterpret_cast<char*>(b + 1);
+	end = reinterpret_cast<char*>(b) + blockSize;
+}
+
+// Postcondition: Every block owned by the arena is freed, and
+//			every pointer it handed out is invalid.
+void json::Arena::release() {
+	while(blocks) {
+		Block* next = blocks->next;
+		::operator delete(blocks);
+		blocks = next;
+	}
+	cur = end = nullptr;
+	used = 0;
+}
+
+void json::Arena::swap(Arena& a) {
+	std::swap(blocks, a.blocks);
+	std::swap(cur, a.cur);
+	std::swap(end, a.end);
+	std::swap(used, a.used);
+}
+
+json::Slice json::Arena::store(const char* data, std::size_t size) {
+	Slice s;
+	s.size = size;
+	if(size == 0) {
+		s.data = "";
+		return s;
+	}
+	char* p = static_cast<char*>(allocate(size, 1));
+	std::memcpy(p, data, size);
+	s.data = p;
+	return s;
+}
+
+//*****************************
+// Slice functions
+//*****************************
+
+// FNV-1a, which is short and spreads short keys well.
+std::uint64_t json::Slice::hash() const {
+	std::uint64_t h = 14695981039346656037ull;
+	for(std::size_t i = 0; i < size; ++i) {
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+bool json::Slice::operator==(Slice const& s) const {
+	return size == s.size && std::memcmp(data, s.data, size) == 0;
+}
+bool json::Slice::operator==(std::string const& s) const {
+	return size == s.size() && std::memcmp(data, s.data(), size) == 0;
+}
+
+std::ostream& json::operator<<(std::ostream& os, Slice const& s) {
+	return os.write(s.data, s.size);
+}
+
+//*****************************
+// Keys member functions
+//*****************************
+
+// Returns the slot holding the key with the given text and hash,
+// or the empty slot it belongs in.
+std::size_t json::Keys::locate(Slice text, std::uint64_t hash) const {
+	std::size_t mask = slots.size() - 1;
+	for(std::size_t i = std::size_t(hash) & mask;; i = (i + 1) & mask) {
+		Key const* k = slots[i];
+		if(!k || (k->hash == hash && k->text == text))
+			return i;
+	}
+}
+
+// Doubles the table, which is kept at most half full.
+void json::Keys::grow() {
+	std::vector<Key const*> old(slots.empty() ? 16 : 2 * slots.size(), nullptr);
+	old.swap(slots);
+	for(Key const* k : old)
+		if(k)
+			slots[locate(k->text, k->hash)] = k;
+}
+
+//Postcondition: Returns the table's only key with the given text.
+//			A new key's characters are copied into the arena.
+json::Key const* json::Keys::intern(Arena& arena, Slice text) {
+	if(2 * (count + 1) > slots.size())
+		grow();
+	std::uint64_t hash = text.hash();
+	std::size_t i = locate(text, hash);
+	if(!slots[i]) {
+		Key* k = arena.create<Key>();
+		k->text = arena.store(text);
+		k->hash = hash;
+		slots[i] = k;
+		++count;
+	}
+	return slots[i];
+}
+
+json::Key const* json::Keys::find(Slice text) const {
+	if(slots.empty())
+		return nullptr;
+	return slots[locate(text, text.hash())];
+}
+
+//*****************************
+// Storage member functions
+//*****************************
+
+// s comes first, ahead of the storages it keeps alive, so when this
+// storage is freed and takes s with it, everything s keeps alive is
+// still held further down this list and is not freed from inside s.
+void json::Storage::keep(std::shared_ptr<Storage const> const& s) {
+	std::unordered_set<Storage const*> have;
+	have.insert(this);
+	for(std::shared_ptr<Storage const> const& k : shared)
+		have.insert(k.get());
+	if(have.insert(s.get()).second)
+		shared.push_back(s);
+	for(std::shared_ptr<Storage const> const& k : s->shared)
+		if(have.insert(k.get()).second)
+			shared.push_back(k);
+}
+
+//*****************************
+// String and literal functions
+//*****************************
+
+json::True json::True::instance;
+json::False json::False::instance;
+json::Null json::Null::instance;
+
+json::String* json::String::make(Arena& arena, Slice s) {
+	String* str = arena.create<String>();
+	if(s.size <= sizeof(str->small)) {
+		std::memcpy(str->small, s.data, s.size);
+		str->value.data = str->small;
+		str->value.size = s.size;
+	} else {
+		str->value = arena.store(s);
+	}
+	return str;
+}
+
+//*****************************
+// Object member functions
+//*****************************
+
+namespace {
+	// Objects with more members than this get a hash table.
+	const std::size_t indexThreshold = 16;
+
+	// Returns the slot holding key, or the empty slot it belongs in.
+	// The members of an object never repeat a key, so keys can be
+	// told apart by their pointers.
+	std::size_t probe(json::Object const* o, json::Key const* key) {
+		std::size_t mask = o->slots - 1;
+		for(std::size_t i = std::size_t(key->hash) & mask;; i = (i + 1) & mask) {
+			std::uint32_t at = o->index[i];
+			if(at == 0 || o->members[at - 1].key == key)
+				return i;
+		}
+	}
+}
+
+//Precondition:  The object has no members yet, and members with the
+//			same key text share the same Key.
+//Postcondition: The object holds a copy of the n given members, in order.
+//			When a key is repeated, only its last value is kept, and it is
+//			placed where the last occurrence was read.
+void json::Object::assign(Arena& arena, Member const* first, std::size_t n) {
+	members = arena.allocateArray<Member>(n);
+	size = 0;
+
+	if(n <= indexThreshold) {
+		// Small objects are checked by comparing keys directly.
+		for(std::size_t i = 0; i < n; ++i) {
+			std::size_t j = i + 1;
+			while(j < n && first[j].key != first[i].key)
+				++j;
+			if(j == n)	// No later member has the same key.
+				members[size++] = first[i];
+		}
+		return;
+	}
+
+	// Large objects are read back to front, so the first time a key is
+	// seen is its last occurrence, and later sightings are dropped.
+	slots = 1;
+	while(slots < 2 * n)
+		slots <<= 1;
+	index = arena.allocateArray<std::uint32_t>(slots);
+	std::fill(index, index + slots, 0);
+
+	for(std::size_t i = n; i-- > 0;) {
+		members[size] = first[i];
+		std::size_t slot = probe(this, first[i].key);
+		if(index[slot] == 0)
+			index[slot] = std::uint32_t(++size);
+	}
+
+	// Put the kept members back in reading order.
+	std::reverse(members, members + size);
+	for(std::size_t i = 0; i < slots; ++i)
+		if(index[i])
+			index[i] = std::uint32_t(size + 1 - index[i]);
+}
+
+//Postcondition: Returns the value stored under key, or nullptr.
+// Keys found this way may come from any table, so they are
+// compared by their characters.
+json::Value* json::Object::find(Slice key) const {
+	if(index) {
+		std::uint64_t hash = key.hash();
+		std::size_t mask = slots - 1;
+		for(std::size_t i = std::size_t(hash) & mask;; i = (i + 1) & mask) {
+			std::uint32_t at = index[i];
+			if(at == 0)
+				return nullptr;
+			Key const* k = members[at - 1].key;
+			if(k->hash == hash && k->text == key)
+				return members[at - 1].value;
+		}
+	}
+	for(std::size_t i = 0; i < size; ++i)
+		if(members[i].key->text == key)
+			return members[i].value;
+	return nullptr;
+}
+json::Value* json::Object::find(std::string const& key) const {
+	Slice s;
+	s.data = key.data();
+	s.size = key.size();
+	return find(s);
+}
 
 //*****************************
 // Namespace json functions
 //*****************************
 
+namespace {
+	// A read-only memory mapping of a whole file, which is
+	// unmapped when it goes out of scope.
+	struct Mapping {
+		const char* data;
+		std::size_t size;
+		bool ok;
+
+		Mapping(std::string const& path) : data(""), size(0), ok(false) {
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if(fd < 0)
+				return;
+
+			struct stat st;
+			if(::fstat(fd, &st) == 0) {
+				if(st.st_size == 0) {	// Empty files cannot be mapped.
+					ok = true;
+				} else {
+					void* p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+					if(p != MAP_FAILED) {
+						data = static_cast<const char*>(p);
+						size = std::size_t(st.st_size);
+						ok = true;
+						::madvise(p, size, MADV_SEQUENTIAL);
+					}
+				}
+			}
+			::close(fd);	// The mapping stays valid after the descriptor is closed.
+		}
+		~Mapping() {
+			if(size)
+				::munmap(const_cast<char*>(data), size);
+		}
+	};
+}
+
+namespace {
+	std::atomic<std::size_t> depthLimit(10000);
+}
+
+std::size_t json::maxDepth() {
+	return depthLimit.load(std::memory_order_relaxed);
+}
+void json::setMaxDepth(std::size_t n) {
+	depthLimit.store(n, std::memory_order_relaxed);
+}
+
 //Precondition: The istream is defined and contains characters to read.
 //Postcondition: Returns a document containing the information from istream.
 json::Document json::parse(std::istream& is) {
 	return Document(is);
 }
 
+//Precondition: data points to size readable characters.
+//Postcondition: Returns a document containing the information from data.
+json::Document json::parse(const char* data, std::size_t size) {
+	return Document(data, size);
+}
+
+//Precondition: data points to size readable characters.
+//Postcondition: Every part of the value in data has been reported to h.
+void json::parse(const char* data, std::size_t size, Handler& h) {
+	Reader<Handler> r(data, size, h);
+	r.read();
+}
+
+//Postcondition: Every part of the value in the file has been reported to h.
+void json::parseFile(std::string const& path, Handler& h) {
+	Mapping file(path);
+	if(!file.ok)
+		throw std::runtime_error("Unable to open " + path + ".");
+	parse(file.data, file.size, h);
+}
+
 //*****************************
 // Document member functions
 //*****************************
 
-// Recursive method that returns Values, 
-// based on the next character in the istream.
-// Postcondition: Document's Value* pointer
-//			contains a proper json document
-//			with information from the istream.
-json::Value* json::Document::parse(std::istream& is) {
-	try {
-		clrWS(is);
-		// Choose Value type based off the next character in the istream.
-		switch(is.peek()) {
-			case '\"': {
-				String* str = new String();
-
-				is.ignore();	// Ignore the first double quote.
-				while(is.peek() != '\"') {	// Append characters until a non-escape sequenced double quote is found.
-					if(is.peek() == '\\')	// Append an additional character if \ is detected.
-						str->value += is.get();
-					str->value += is.get();
-				}
-				is.ignore();	// Ignore the last double quote.
+// The istream constructor is a thin wrapper that reads everything
+// left in the stream into one buffer, so the parser itself never
+// has to go through the stream a character at a time.
+json::Document::Document(std::istream& is) : store(std::make_shared<Storage>()), head(nullptr) {
+	std::string buffer;
+	char chunk[1 << 16];
+	while(is.read(chunk, sizeof(chunk)) || is.gcount())
+		buffer.append(chunk, std::size_t(is.gcount()));
+	load(buffer.data(), buffer.size());
+}
 
-				return str;
-			}
-			case '{': {
-				Object* obj = new Object();
-
-				is.ignore();	// Ignore the first { symbol.
-				clrWS(is);
-
-				while(is.peek() != '}') {	// Append values until an end brace is found.
-					// Get the string value from the istream and add set it as the key.
-					String* str = dynamic_cast<String*>(parse(is));
-					std::string key = str->value;
-					delete str;
-				
-					// These three lines remove any whitespace and the colon between key/value.
-					clrWS(is);
-					is.ignore();
-					clrWS(is);
-				
-					Value* val = parse(is);
-				
-					// Check if a value has already been assigned to the map. If it has, overwrite it.
-					auto position = std::find(obj->insertOrder.begin(), obj->insertOrder.end(), key);
-					if(position != obj->insertOrder.end())
-						obj->insertOrder.erase(position);
-					obj->insertOrder.push_back(key);
-
-					// Assign the value to the key.
-					obj->values[key] = val;
-
-					clrWS(is);
-					// Check if there is a comma, indicating more pairs.
-					if(is.peek() == ',') {
-						is.ignore();	// Ignore the comma symbol.
-						clrWS(is);
-					}
-				}
+// Maps the file at path into memory and parses it in place.
+// Postcondition: Returns a document containing the file's value,
+//			or a blank document if the file could not be opened,
+//			which is reported on stderr.
+json::Document json::Document::fromFile(std::string const& path) {
+	Document d;
+	Mapping file(path);
+	if(!file.ok) {
+		std::cerr << "Unable to open " << path << '.' << std::endl;
+		return d;
+	}
+	d.load(file.data, file.size);	// Every value is copied into the arena.
+	return d;
+}
 
-				is.ignore(); // Ignore the ] symbol.
+json::Document json::Document::fromBinary(const char* data, std::size_t size) {
+	std::shared_ptr<std::string> bytes = std::make_shared<std::string>(data, size);
+	Document d;
+	std::shared_ptr<Tape const> t = Tape::deserialize(bytes->data(), bytes->size(), bytes);
+	if(t->length)	// A blank document has no tape.
+		d.flat = t;
+	return d;
+}
 
-				return obj;
-			}
-			case '[': {
-				Array* arr = new Array();
+json::Document json::Document::loadBinary(std::string const& path) {
+	Document d;
+	std::shared_ptr<Mapping> file = std::make_shared<Mapping>(path);
+	if(!file->ok)
+		throw std::runtime_error("Unable to open " + path + ".");
+	// The tape keeps the file mapped for as long as it lives.
+	std::shared_ptr<Tape const> t = Tape::deserialize(file->data, file->size, file);
+	if(t->length)
+		d.flat = t;
+	return d;
+}
 
-				is.ignore();	// Ignore the [ symbol.
-				clrWS(is);
+/*	The Builder is the Handler that turns parser events into Values.
+	Objects and arrays are only given their final storage in the
+	arena once all of their values have been read. Until then, their
+	values are collected on scratch stacks shared by every level.
+*/
+struct json::Document::Builder final : Handler {
+	// One entry for each object or array that is still open.
+	struct Frame {
+		bool object;
+		std::size_t base;	// Where this container's values start on its stack.
+		Key const* key;		// The key of the member being read, for objects.
+	};
 
-				while(is.peek() != ']') {	// Loop until end-brace is found.
-					Value* val = parse(is);	// Parse the next value in the istream.
-					arr->values.push_back(val);	// Append said value to the array.
+	Arena& arena;
+	Keys& keys;
+	Value* root;
+	std::vector<Frame> frames;
+	std::vector<Value*> values;
+	std::vector<Member> members;
 
-					clrWS(is);
-					// Check if there is a comma, indicating more values.
-					if(is.peek() == ','){
-						is.ignore();	// Ignore the comma symbol.
-						clrWS(is);
-					}
+	Builder(Storage& s) : arena(s.arena), keys(s.keys), root(nullptr) { }
+
+	// Hands a finished value to the container it belongs to.
+	void add(Value* v) {
+		if(frames.empty()) {
+			root = v;
+		} else if(frames.back().object) {
+			Member m;
+			m.key = frames.back().key;
+			m.value = v;
+			members.push_back(m);
+		} else {
+			values.push_back(v);
+		}
+	}
+
+	void onObjectBegin() {
+		Frame f = { true, members.size(), nullptr };
+		frames.push_back(f);
+	}
+	void onKey(Slice key) {
+		frames.back().key = keys.intern(arena, key);
+	}
+	void onObjectEnd() {
+		// Move this object's members from the stack into the arena.
+		std::size_t base = frames.back().base;
+		frames.pop_back();
+		Object* obj = arena.create<Object>();
+		obj->assign(arena, members.data() + base, members.size() - base);
+		members.resize(base);
+		add(obj);
+	}
+	void onArrayBegin() {
+		Frame f = { false, values.size(), nullptr };
+		frames.push_back(f);
+	}
+	void onArrayEnd() {
+		// Move this array's values from the stack into the arena.
+		std::size_t base = frames.back().base;
+		frames.pop_back();
+		Array* arr = arena.create<Array>();
+		arr->size = values.size() - base;
+		arr->values = arena.allocateArray<Value*>(arr->size);
+		std::copy(values.begin() + base, values.end(), arr->values);
+		values.resize(base);
+		add(arr);
+	}
+	void onString(Slice s) {
+		add(String::make(arena, s));
+	}
+	void onNumber(Slice s) {
+		add(Number::make(arena, s));
+	}
+	void onTrue()  { add(&True::instance); }
+	void onFalse() { add(&False::instance); }
+	void onNull()  { add(&Null::instance); }
+};
+
+/*	The FilterBuilder is the Handler that filters a value while it is
+	being read. Every object and array is given a frame that collects
+	what is kept of it, like the Filter's, and strings, numbers and
+	literals outside a matching member are dropped as soon as they are
+	reported. Once a key matches, its whole value is handed to a
+	Builder, and comes out as a single kept member.
+
+	Keys are only interned for members that are kept. Until then, the
+	key of the member being read is copied into its frame, since the
+	slice the parser reports is gone once onKey returns.
+	Each object's frame also maps the Key of every member kept so far
+	to where it is on members, so a repeated key finds the member it
+	replaces with one lookup, however wide the object is.
+*/
+struct json::Document::FilterBuilder final : Handler {
+	struct Frame {
+		bool object;
+		std::size_t base;	// Where this container's kept values start on its stack.
+		std::string key;	// The key of the member being read, for objects.
+		std::unordered_map<Key const*, std::size_t> kept;	// Kept members' positions on members.
+	};
+
+	std::vector<std::string> const& args;
+	Storage& store;
+	Builder builder;
+	std::size_t building;	// How deeply builder is nested in the value it is building, if at all.
+	bool matched;			// The next value belongs to a member that matched.
+	Value* root;
+	std::vector<Frame> frames;
+	std::size_t depth;		// Frames in use; frames are kept to reuse their keys' memory.
+	std::vector<Value*> values;
+	std::vector<Member> members;
+
+	FilterBuilder(std::vector<std::string> const& a, Storage& s)
+		: args(a), store(s), builder(s), building(0), matched(false), root(nullptr), depth(0) { }
+
+	// Hands a kept value to the container it belongs to.
+	void add(Value* v) {
+		if(!depth) {
+			root = v;
+		} else if(frames[depth - 1].object) {
+			std::string const& k = frames[depth - 1].key;
+			Slice text = { k.data(), k.size() };
+			Member m;
+			m.key = store.keys.intern(store.arena, text);
+			m.value = v;
+			frames[depth - 1].kept[m.key] = members.size();
+			members.push_back(m);
+		} else {
+			values.push_back(v);
+		}
+	}
+	// Keeps the value builder has just finished, if it has.
+	void finish() {
+		if(building)
+			return;
+		add(builder.root);
+		builder.root = nullptr;
+	}
+	void open(bool object) {
+		if(depth == frames.size())
+			frames.push_back(Frame());
+		Frame& f = frames[depth++];
+		f.object = object;
+		f.base = object ? members.size() : values.size();
+		if(f.kept.bucket_count() > 64)	// Clearing a big table costs as much as its buckets.
+			std::unordered_map<Key const*, std::size_t>().swap(f.kept);
+		else
+			f.kept.clear();
+	}
+
+	void onObjectBegin() {
+		if(building || matched) {
+			++building;
+			matched = false;
+			builder.onObjectBegin();
+		} else {
+			open(true);
+		}
+	}
+	void onKey(Slice key) {
+		if(building) {
+			builder.onKey(key);
+			return;
+		}
+		Frame& f = frames[depth - 1];
+		f.key.assign(key.data, key.size);
+		// A repeated key replaces the member before it, as it does
+		// when the whole object is read, so whatever was kept for that
+		// member goes, even if nothing is kept for this one. It is only
+		// marked as gone here, so the positions of the others stay put.
+		// A key that was never interned cannot have been kept.
+		if(!f.kept.empty()) {
+			if(Key const* k = store.keys.find(key)) {
+				std::unordered_map<Key const*, std::size_t>::iterator at = f.kept.find(k);
+				if(at != f.kept.end()) {
+					members[at->second].value = nullptr;
+					f.kept.erase(at);
 				}
+			}
+		}
+		for(std::string const& a : args)
+			if(key == a)
+				matched = true;
+	}
+	void onObjectEnd() {
+		if(building) {
+			--building;
+			builder.onObjectEnd();
+			finish();
+			return;
+		}
+		// Only keep an object if something was kept in it.
+		std::size_t base = frames[--depth].base;
+		members.erase(std::remove_if(members.begin() + base, members.end(),
+				[](Member const& m) { return m.value == nullptr; }), members.end());
+		if(members.size() > base) {
+			Object* obj = store.arena.create<Object>();
+			obj->assign(store.arena, members.data() + base, members.size() - base);
+			members.resize(base);
+			add(obj);
+		}
+	}
+	void onArrayBegin() {
+		if(building || matched) {
+			++building;
+			matched = false;
+			builder.onArrayBegin();
+		} else {
+			open(false);
+		}
+	}
+	void onArrayEnd() {
+		if(building) {
+			--building;
+			builder.onArrayEnd();
+			finish();
+			return;
+		}
+		std::size_t base = frames[--depth].base;
+		if(values.size() > base) {
+			Array* arr = store.arena.create<Array>();
+			arr->size = values.size() - base;
+			arr->values = store.arena.allocateArray<Value*>(arr->size);
+			std::copy(values.begin() + base, values.end(), arr->values);
+			values.resize(base);
+			add(arr);
+		}
+	}
+	// Strings, numbers and literals are only built for a matched member.
+	void onString(Slice s) {
+		if(building || matched) {
+			matched = false;
+			builder.onString(s);
+			finish();
+		}
+	}
+	void onNumber(Slice s) {
+		if(building || matched) {
+			matched = false;
+			builder.onNumber(s);
+			finish();
+		}
+	}
+	void onTrue() {
+		if(building || matched) {
+			matched = false;
+			builder.onTrue();
+			finish();
+		}
+	}
+	void onFalse() {
+		if(building || matched) {
+			matched = false;
+			builder.onFalse();
+			finish();
+		}
+	}
+	void onNull() {
+		if(building || matched) {
+			matched = false;
+			builder.onNull();
+			finish();
+		}
+	}
+};
+
+// Parses a single value from the given range of characters.
+// Postcondition: head points to the parsed value, or to Null
+//			if the characters are not a complete json value.
+void json::Document::load(const char* data, std::size_t size) {
+	try {
+		read(data, size);
+	} catch (...) {
+		// Any exception that might be found returns Null and displays error message on stderr.
+		std::cerr << "Unable to parse input." << std::endl;
+		head = &Null::instance;
+	}
+}
+
+// Parses a single value from the given range of characters.
+// Postcondition: head points to the parsed value; throws ParseError
+//			if the characters are not a complete json value, or
+//			anything but whitespace follows it.
+void json::Document::read(const char* data, std::size_t size) {
+	StatsTimer t(StatsCollector::ParseNanos);
+	Builder b(*store);
+	readWhole(data, size, b);
+	head = b.root;
+}
+
+json::Document json::Document::parseStrict(const char* data, std::size_t size) {
+	Document d;
+	d.read(data, size);
+	return d;
+}
+
+json::Document json::Document::parseFiltered(const char* data, std::size_t size, std::vector<std::string> const& keys) {
+	StatsTimer t(StatsCollector::ParseNanos);
+	Document d;
+	FilterBuilder b(keys, *d.store);
+	readWhole(data, size, b);
+	d.head = b.root;
+	return d;
+}
+
+json::Document json::Document::parseTape(const char* data, std::size_t size) {
+	StatsTimer t(StatsCollector::ParseNanos);
+	Document d;
+	d.flat = Tape::parse(data, size);
+	return d;
+}
 
-				is.ignore();	// Ignore the ] symbol.
+//*****************************
+// DocumentBuilder member functions
+//*****************************
+
+json::DocumentBuilder::DocumentBuilder() : builder(new Document::Builder(*doc.store)) { }
+json::DocumentBuilder::~DocumentBuilder() { }
 
-				return arr;
+void json::DocumentBuilder::onObjectBegin()  { builder->onObjectBegin(); }
+void json::DocumentBuilder::onKey(Slice key) { builder->onKey(key); }
+void json::DocumentBuilder::onObjectEnd()    { builder->onObjectEnd(); }
+void json::DocumentBuilder::onArrayBegin()   { builder->onArrayBegin(); }
+void json::DocumentBuilder::onArrayEnd()     { builder->onArrayEnd(); }
+void json::DocumentBuilder::onString(Slice s) { builder->onString(s); }
+void json::DocumentBuilder::onNumber(Slice s) { builder->onNumber(s); }
+void json::DocumentBuilder::onTrue()  { builder->onTrue(); }
+void json::DocumentBuilder::onFalse() { builder->onFalse(); }
+void json::DocumentBuilder::onNull()  { builder->onNull(); }
+
+json::Document json::DocumentBuilder::document() {
+	if(!builder->root || !builder->frames.empty())
+		throw ParseError("unexpected end of input");
+	doc.head = builder->root;
+	Document d = std::move(doc);
+	doc = Document();
+	builder.reset(new Document::Builder(*doc.store));
+	return d;
+}
+
+namespace {
+	// Inputs smaller than this are not worth splitting between threads,
+	// and neither are pieces smaller than this.
+	const std::size_t parallelMinimum = 1 << 20;
+	const std::size_t pieceMinimum = 1 << 18;
+
+	/*	A Segment is an equal share of the input, which is walked
+		by one thread to find a safe place to split the array.
+		Where strings start and end decides which brackets and commas
+		count, and a segment cannot know if it starts inside a string
+		without walking everything before it. So each segment first
+		works out what it does to the depth for both cases, which only
+		takes counting; the real state at each segment's start then
+		follows from the segments before it.
+	*/
+	struct Segment {
+		std::size_t first, last;
+		bool oddQuotes;		// Holds an odd number of unescaped quotes.
+		long change[2];		// Change in depth if it starts outside [0] or inside [1] a string.
+		bool inString;		// The state at its start, once known.
+		long depth;
+		std::size_t cut;	// The first comma between top-level elements, or 0.
+	};
+
+	// Whether the character at i is escaped, which only depends
+	// on the backslashes right before it.
+	bool escapedAt(const char* data, std::size_t i) {
+		bool escaped = false;
+		while(i > 0 && data[--i] == '\\')
+			escaped = !escaped;
+		return escaped;
+	}
+
+	void measure(const char* data, Segment& s) {
+		bool escaped = escapedAt(data, s.first);
+		bool in = false;	// Whether a segment starting outside a string is in one now.
+		s.oddQuotes = false;
+		s.change[0] = s.change[1] = 0;
+		for(std::size_t i = s.first; i < s.last; ++i) {
+			if(escaped) {
+				escaped = false;
+				continue;
 			}
-			case 't': {
-				is.ignore(4);	// 'true' detected; ignore the next four characters in the stream.
-				return new True();
+			switch(data[i]) {
+				case '\\': escaped = true; break;
+				case '\"': in = !in; s.oddQuotes = !s.oddQuotes; break;
+				case '{': case '[': ++s.change[in]; break;
+				case '}': case ']': --s.change[in]; break;
 			}
-			case 'f': {
-				is.ignore(5);	// 'false' detected; ignore the next five characters in the stream.
-				return new False();
+		}
+	}
+
+	void findCut(const char* data, Segment& s) {
+		bool escaped = escapedAt(data, s.first);
+		bool in = s.inString;
+		long depth = s.depth;
+		s.cut = 0;
+		for(std::size_t i = s.first; i < s.last; ++i) {
+			if(escaped) {
+				escaped = false;
+				continue;
 			}
-			case 'n': {
-				is.ignore(4);	// 'null' detected; ignore the next four characters in the stream.
-				return new Null();
+			char c = data[i];
+			if(c == '\\')
+				escaped = true;
+			else if(c == '\"')
+				in = !in;
+			else if(in)
+				continue;
+			else if(c == '{' || c == '[')
+				++depth;
+			else if(c == '}' || c == ']')
+				--depth;
+			else if(c == ',' && depth == 1) {
+				s.cut = i;
+				return;
 			}
-			default: {
-				// If the next character doesn't match any other value type, it must be a number.
-				Number* num = new Number();
+		}
+	}
 
-				// Append characters to the number's string until whitespace, an end brace, or a comma is found.
-				while(!(is.peek() == ' ' || is.peek() == ',' || is.peek() == '}' || is.peek() == ']'))
-					num->value += is.get();
+	bool space(char c) {
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+	}
+}
 
-				return num;
-			}
+// Parses each piece of a large array on its own thread, into its own
+// storage, then puts the pieces' elements together in a single Array.
+// Finding where to split is done in parallel too, so no step walks
+// the whole input on one thread.
+// Any input this cannot split, and any error, goes to parseStrict, so
+// the result and the error messages are exactly those of a serial parse.
+json::Document json::Document::parseParallel(const char* data, std::size_t size, unsigned threads) {
+	if(threads == 0)
+		threads = Pool::defaultThreads();
+	std::size_t n = std::min<std::size_t>(4 * threads, size / pieceMinimum);
+	if(threads < 2 || size < parallelMinimum || n < 2)
+		return parseStrict(data, size);
+
+	std::size_t open = 0, close = size;
+	while(open < size && space(data[open]))
+		++open;
+	while(close > open && space(data[close - 1]))
+		--close;
+	if(close - open < 2 || data[open] != '[' || data[--close] != ']')
+		return parseStrict(data, size);
+
+	// A serial parse this falls back to counts itself, so the timer
+	// is stopped before each fallback, and only counts the attempt to split.
+	StatsTimer t(StatsCollector::ParseNanos);
+	Pool pool(threads);
+	std::vector<Segment> segments(n);
+	for(std::size_t i = 0; i < n; ++i) {
+		segments[i].first = open + (close - open) * i / n;
+		segments[i].last = open + (close - open) * (i + 1) / n;
+		Segment* s = &segments[i];
+		pool.submit([data, s] { measure(data, *s); });
+	}
+	pool.wait();
+
+	bool in = false;
+	long depth = 0;
+	for(Segment& s : segments) {
+		s.inString = in;
+		s.depth = depth;
+		depth += s.change[in];
+		in = in != s.oddQuotes;
+	}
+	if(in || depth != 1) {	// The closing bracket has not been counted yet.
+		t.stop();
+		return parseStrict(data, size);
+	}
+
+	for(std::size_t i = 1; i < n; ++i) {
+		Segment* s = &segments[i];
+		pool.submit([data, s] { findCut(data, *s); });
+	}
+	pool.wait();
+
+	// Each piece runs from just past one cut to the next.
+	std::vector<std::size_t> starts(1, open + 1), ends;
+	for(std::size_t i = 1; i < n; ++i) {
+		if(segments[i].cut) {
+			ends.push_back(segments[i].cut);
+			starts.push_back(segments[i].cut + 1);
 		}
-	} catch (...) {
-		// Any exception that might be found returns Null and displays error message.
-		std::cout << "Unable to parse input." << std::endl;
-		return new Null();
-	}
-}
-
-//Precondition:  The istream is defined and contains characters to read.
-//Postcondition: The istream's next character is not a space.
-	/*	Note: When it came to clearing whitespace from the stream, I had
-			the option of simply using the >> operator to get the next 
-			line without any preceding whitespace. The problem with this
-			is that it could easily include way more than intended. This
-			is why I created a method that loops until it finds the start
-			of the next readable, non-whitespace character.
-				e.g. If the characters in the istream were 
-					'  {"Key":"Value","Key2",   "Value"}', using >> would 
-					read all the way up to the end of "Key2", making it 
-					harder to detect the correct values from the istream.
-	*/
-void json::Document::clrWS(std::istream& is) {
-	while(is.peek() == ' ')
-		is.ignore();
+	}
+	ends.push_back(close);
+
+	std::size_t pieces = starts.size();
+	std::vector<std::shared_ptr<Storage> > stores(pieces);
+	std::vector<Array*> parts(pieces);
+	std::vector<char> failed(pieces, false);	// Not vector<bool>, which threads cannot share.
+	// Each piece's values are counted on their own, and only added to
+	// the stats if every piece is parsed.
+	StatsCollector* collector = StatsCollector::enabled ? StatsCollector::current() : nullptr;
+	std::vector<Census> counts(pieces);
+	for(std::size_t i = 0; i < pieces; ++i) {
+		std::size_t first = starts[i], last = ends[i];
+		pool.submit([=, &stores, &parts, &failed, &counts] {
+			try {
+				std::shared_ptr<Storage> store = std::make_shared<Storage>();
+				Builder b(*store);
+				b.onArrayBegin();
+				if(collector) {
+					Counted<Builder> c(b);
+					Reader<Counted<Builder> > r(data + first, last - first, c);
+					r.elements();
+					counts[i] = c.census;
+				} else {
+					Reader<Builder> r(data + first, last - first, b);
+					r.elements();
+				}
+				b.onArrayEnd();
+				stores[i] = store;
+				parts[i] = static_cast<Array*>(b.root);
+			} catch (...) {
+				failed[i] = true;
+			}
+		});
+	}
+	pool.wait();
+	if(std::find(failed.begin(), failed.end(), true) != failed.end()) {
+		t.stop();
+		return parseStrict(data, size);
+	}
+
+	Document d;
+	std::size_t total = 0;
+	for(Array* a : parts)
+		total += a->size;
+	Array* whole = d.store->arena.create<Array>();
+	whole->size = total;
+	whole->values = d.store->arena.allocateArray<Value*>(total);
+	Value** next = whole->values;
+	for(std::size_t i = 0; i < pieces; ++i) {
+		next = std::copy(parts[i]->values, parts[i]->values + parts[i]->size, next);
+		d.store->parts.push_back(stores[i]);
+	}
+	d.head = whole;
+	t.stop();
+	if(collector) {
+		Census total;	// The array around every piece's elements.
+		++total.counts[StatsCollector::Arrays];
+		total.enter();
+		for(Census const& c : counts)
+			total.add(c);
+		total.report(*collector, size);
+	}
+	return d;
 }
 
-// Creates a Printer visitor to navigate the
+// Builds the tree of Values for a document kept as a tape, in a
+// storage of its own, since other documents may share the old one.
+// Postcondition: The document is kept as a tree.
+void json::Document::unflatten() {
+	if(!flat)
+		return;
+	std::shared_ptr<Storage> fresh = std::make_shared<Storage>();
+	Builder b(*fresh);
+	flat->replay(flat->root(), b);
+	store = fresh;
+	head = b.root;
+	flat.reset();
+}
+
+// Creates a Writer to navigate the
 // document's Value pointer.
 // Postcondition: Json Document is output to 
 // 		given ostream in 'pretty print' format.
 void json::Document::print(std::ostream& os) const {
+	StatsTimer t(StatsCollector::PrintNanos);
+	if(flat) {
+		Writer w(Format::Pretty, os);
+		w.write(flat->root());
+		w.flush();
+		return;
+	}
 	if(!head) {	// Print out null if head is undefined.
 		os << "null";
 		return;
 	}
 
-	Printer p(os);
-	head->accept(p);
+	Writer w(Format::Pretty, os);
+	w.write(head);
+	w.flush();
 }
 
-// Creates a Filter visitor to navigate the
-// document's Value pointer.
-// Postcondition: Returns an Object ponter containing
-//			all key/value pairs containing args
-json::Document json::Document::filter(std::vector<std::string>& args) const {
-	if(!head) {	// Return a blank document if head is undefined.
-		Document d;
-		return d;
-	}
-
-	Filter f(args);
-	head->accept(f);
+// Postcondition: Json Document is written to the
+//		file descriptor in the given format; throws
+//		std::invalid_argument if fd is negative, and
+//		std::runtime_error if writing to it fails.
+void json::Document::print(int fd, Format f) const {
+	StatsTimer t(StatsCollector::PrintNanos);
+	Writer w(f, fd);
+	if(flat)
+		w.write(flat->root());
+	else
+		w.write(head ? head : &Null::instance);	// Print out null if head is undefined.
+	w.flush();
+}
 
-	if(f.result) {		// If the result is not nullptr
-		Duplicator d;	// Copy all values contained by the pointer.
-		f.result->accept(d);
-		return Document(d.copy);	// Return it as a document.
-	} else {			// Otherwise, return a blank document.
-		Document d;
-		return d;
+namespace {
+	// Collects every Key for the given texts in s and in all the
+	// storages it keeps alive, since a document's objects can hold
+	// keys from any of them. Storages are visited from an explicit
+	// stack, each one once.
+	void lookup(json::Storage const& s, std::vector<std::string> const& texts, std::vector<json::Key const*>& keys) {
+		std::unordered_set<json::Storage const*> seen;
+		std::vector<json::Storage const*> pending(1, &s);
+		while(!pending.empty()) {
+			json::Storage const* next = pending.back();
+			pending.pop_back();
+			if(!seen.insert(next).second)
+				continue;
+			for(std::string const& t : texts) {
+				json::Slice text = { t.data(), t.size() };
+				if(json::Key const* k = next->keys.find(text))
+					keys.push_back(k);
+			}
+			for(std::shared_ptr<json::Storage const> const& other : next->shared)
+				pending.push_back(other.get());
+			for(std::shared_ptr<json::Storage const> const& part : next->parts)
+				pending.push_back(part.get());
+		}
 	}
 }
 
-// Creates a Duplicator visitor to copy
-// the document.
-// Postcondition: Returns a copy of the
-// document.
-json::Document json::Document::copy() const {
-	if(!head){	// Return a blank document if head is undefined.
-		Document d;
-		return d;
-	}
-	Duplicator d;
-	head->accept(d);
-	return Document(d.copy);
+namespace {
+	// Objects and arrays with fewer members or elements than this are
+	// filtered on the calling thread, since starting threads costs more.
+	const std::size_t splitMinimum = 1 << 12;
+	// Fewest members or elements a thread is given.
+	const std::size_t shareMinimum = 1 << 10;
+	// How many levels down from the top a large object or array is looked for.
+	const unsigned splitDepth = 4;
 }
 
-// Creates an Exporter visitor to navigate the
-// document's Value pointer.
-// Postcondition: Returns a string in legal json format
-//			that represents this Json Document.
-std::string json::Document::output() const {
-	if(!head)	// Return Null value if head is not defined.
-		return "";
+/*	The Splitter looks for large objects and arrays in the top few
+	levels of a value. The members or elements of each one it finds
+	are split into runs, and each run is filtered by a Filter of its
+	own on the pool, into a storage that becomes one of the parts of
+	the result's storage. The runs' results are then put together in
+	their original order, so the result is the same as the Filter's.
+	Everything else is filtered on the calling thread, and so are
+	the runs of any object or array whose threads failed.
+*/
+struct json::Document::Splitter {
+	std::vector<Key const*> const& keys;
+	Storage& target;
+	unsigned threads;
+	std::unique_ptr<Pool> pool;	// Started when the first large object or array is found.
+	Filter serial;
 
-	Exporter e;
-	head->accept(e);
-	return e.output;
-}
+	Splitter(std::vector<Key const*> const& k, Storage& t, unsigned n)
+		: keys(k), target(t), threads(n), serial(k, t.arena) { }
 
-//*****************************
-// Printer member functions
-//*****************************
+	// Returns what is left of v, which is level levels below the top.
+	Value* run(Value* v, unsigned level);
+	// Returns what is left of an object or array split between threads,
+	// or false if a thread failed.
+	bool split(Value* v, Value*& result);
 
-void json::Document::Printer::visit(String* s) {
-	os << '\"' << s->value << '\"';
-}
-void json::Document::Printer::visit(Object* o) {
-	os << "{\n";
-	tab++;
-	for(auto it = o->insertOrder.begin(); it != o->insertOrder.end();) {
-		printTabs();
+	bool matches(Key const* k) const { return std::find(keys.begin(), keys.end(), k) != keys.end(); }
+	Value* make(std::vector<Member> const&, std::vector<Value*> const&, bool object);
+};
 
-		// Print the key value followed by a colon.
-		os << '\"' << *it << "\": ";
+// Only the top splitDepth levels are recursed through; everything
+// below them is left to the Filter, which keeps its own stack.
+json::Value* json::Document::Splitter::run(Value* v, unsigned level) {
+	if(v->type != Type::Object && v->type != Type::Array)
+		return nullptr;
+	bool object = v->type == Type::Object;
+	std::size_t size = object ? static_cast<Object*>(v)->size : static_cast<Array*>(v)->size;
 
-		// Send this visitor to the Value to print it.
-		o->values[*it]->accept(*this);
+	Value* result;
+	if(size >= splitMinimum && split(v, result))
+		return result;
+	if(threads < 2 || size >= splitMinimum || level == splitDepth)
+		return serial.run(v);
 
-		it++;
-		// Print a comma if the object contains more pairs.
-		if(it != o->insertOrder.end())
-			os << ",\n";
+	std::vector<Member> members;
+	std::vector<Value*> values;
+	for(std::size_t i = 0; i < size; ++i) {
+		if(object) {
+			Member m = static_cast<Object*>(v)->members[i];
+			if(!matches(m.key) && !(m.value = run(m.value, level + 1)))
+				continue;
+			members.push_back(m);
+		} else if(Value* r = run(static_cast<Array*>(v)->values[i], level + 1)) {
+			values.push_back(r);
+		}
 	}
-	tab--;
-	os << '\n';
-	printTabs();
-	os << '}';
+	return make(members, values, object);
 }
-void json::Document::Printer::visit(Array* a) {
-	os << "[\n";
-	tab++;
-	for(auto it = a->values.begin(); it != a->values.end();) {
-		printTabs();
 
-		// Send this visitor to the Value to print it.
-		(*it)->accept(*this);
+bool json::Document::Splitter::split(Value* v, Value*& result) {
+	bool object = v->type == Type::Object;
+	std::size_t size = object ? static_cast<Object*>(v)->size : static_cast<Array*>(v)->size;
+	std::size_t n = std::min<std::size_t>(4 * threads, size / shareMinimum);
+	if(threads < 2 || n < 2)
+		return false;
+	if(!pool)
+		pool.reset(new Pool(threads));
+
+	std::vector<std::shared_ptr<Storage> > stores(n);
+	std::vector<std::vector<Member> > members(n);
+	std::vector<std::vector<Value*> > values(n);
+	std::vector<char> failed(n, false);	// Not vector<bool>, which threads cannot share.
+	for(std::size_t i = 0; i < n; ++i) {
+		std::size_t first = size * i / n, last = size * (i + 1) / n;
+		pool->submit([=, &stores, &members, &values, &failed] {
+			try {
+				std::shared_ptr<Storage> store = std::make_shared<Storage>();
+				Filter f(keys, store->arena);
+				for(std::size_t j = first; j < last; ++j) {
+					if(object) {
+						Member m = static_cast<Object*>(v)->members[j];
+						if(!matches(m.key) && !(m.value = f.run(m.value)))
+							continue;
+						members[i].push_back(m);
+					} else if(Value* r = f.run(static_cast<Array*>(v)->values[j])) {
+						values[i].push_back(r);
+					}
+				}
+				stores[i] = store;
+			} catch (...) {
+				failed[i] = true;
+			}
+		});
+	}
+	pool->wait();
+	if(std::find(failed.begin(), failed.end(), true) != failed.end())
+		return false;
 
-		it++;
-		// Print a comma if the array contains more values.
-		if(it != a->values.end())
-			os << ",\n";
+	// Put the runs back together in order.
+	for(std::size_t i = 1; i < n; ++i) {
+		members[0].insert(members[0].end(), members[i].begin(), members[i].end());
+		values[0].insert(values[0].end(), values[i].begin(), values[i].end());
 	}
-	tab--;
-	os << '\n';
-	printTabs();
-	os << ']';
+	for(std::shared_ptr<Storage>& s : stores)
+		if(s->arena.bytes())	// Only keep the storages something was made in.
+			target.parts.push_back(s);
+	result = make(members[0], values[0], object);
+	return true;
 }
-void json::Document::Printer::visit(True* t) {
-	os << "true";
+
+// Only builds an object or array if something was found in it.
+json::Value* json::Document::Splitter::make(std::vector<Member> const& members, std::vector<Value*> const& values, bool object) {
+	if(object) {
+		if(members.empty())
+			return nullptr;
+		Object* o = target.arena.create<Object>();
+		o->assign(target.arena, members.data(), members.size());
+		return o;
+	}
+	if(values.empty())
+		return nullptr;
+	Array* a = target.arena.create<Array>();
+	a->size = values.size();
+	a->values = target.arena.allocateArray<Value*>(a->size);
+	std::copy(values.begin(), values.end(), a->values);
+	return a;
 }
-void json::Document::Printer::visit(False* f) {
-	os << "false";
+
+// Creates a Filter to navigate the
+// document's Value pointer.
+// Postcondition: Returns a document containing
+//			all key/value pairs containing args.
+//			Its new objects and arrays are allocated in its own arena,
+//			and every other value is shared with this document.
+json::Document json::Document::filter(std::vector<std::string>& args, unsigned threads) const {
+	StatsTimer t(StatsCollector::FilterNanos);
+	Document d;
+	if(flat) {	// Tapes are filtered into a new tape.
+		d.flat = flat->filter(args);
+		return d;
+	}
+	if(!head)	// Return a blank document if head is undefined.
+		return d;
+
+	std::vector<Key const*> keys;
+	lookup(*store, args, keys);
+
+	if(threads == 0)
+		threads = Pool::defaultThreads();
+	Splitter f(keys, *d.store, threads);
+	Value* result = f.run(head, 0);
+
+	if(result) {		// If the result is not nullptr
+		d.head = result;
+		d.keep(store);	// Keep this document's values alive.
+	}
+	return d;			// Otherwise, return a blank document.
 }
-void json::Document::Printer::visit(Null* n) {
-	os << "null";
+
+// Postcondition: Returns a copy of the document, which
+//			shares all of its values with this one.
+json::Document json::Document::copy() const {
+	return *this;
 }
-void json::Document::Printer::visit(Number* n) {
-	os << n->value;
+
+// Creates a Duplicator to copy every value
+// reachable from this document into a new arena.
+// Postcondition: Returns a copy of the document
+//			that shares no storage with any other document.
+json::Document json::Document::materialize() const {
+	Document d;
+	if(flat) {
+		d.flat = flat->clone();
+		return d;
+	}
+	if(!head)	// Return a blank document if head is undefined.
+		return d;
+
+	Duplicator c(*d.store);
+	d.head = c.run(head);
+	return d;
 }
 
-// Output 2 empty spaces for each tab of the printer visitor.
-void json::Document::Printer::printTabs() {
-	for(int i = 0; i < tab; ++i) 
-		os << "  ";
+namespace {
+	// How many storages a document keeps alive before its values are
+	// copied into one storage of their own, so a document changed over
+	// and over does not hold on to every storage it has ever had.
+	const std::size_t keepLimit = 64;
 }
 
-//*****************************
-// Filter member functions
-//*****************************
+// Returns the storage new values for this document should go in.
+// A storage that other documents share is never added to, so they
+// can keep reading it from other threads; this document gets a
+// new storage that keeps the shared one alive instead.
+json::Storage& json::Document::writable() {
+	if(!store || store.use_count() > 1) {
+		std::shared_ptr<Storage> old = store;
+		store = std::make_shared<Storage>();
+		if(old)
+			keep(old);
+	}
+	return *store;
+}
 
-void json::Document::Filter::visit(String* s) { }
-void json::Document::Filter::visit(Object* o) {
-	Object* object = new Object();
+// Postcondition: This document's storage keeps s alive. If that takes
+//			it past keepLimit storages, the document is materialized
+//			instead, and keeps nothing else alive.
+void json::Document::keep(std::shared_ptr<Storage const> const& s) {
+	store->keep(s);
+	if(store->shared.size() > keepLimit && head)
+		*this = materialize();
+}
 
-	for(std::string& s : o->insertOrder) {	// Iterate through each key value of o.
-		if(std::find(args.begin(), args.end(), s) != args.end()) { 
-			// Key matches an argument.
+// Rebuilds the containers along path, starting with v, so the value
+// at the end of the path becomes value. A null value removes the
+// member or element instead. The path is walked down in a loop to
+// find the container at each step, and they are rebuilt on the way
+// back up, so no length of path can run out of stack.
+// Postcondition: Returns the new version of v. Nothing off the path is
+//			copied, and v itself is returned if nothing had to change.
+json::Value* json::Document::update(Value* v, std::vector<std::string> const& path, Value* value, Storage& target) {
+	Arena& arena = target.arena;
+	// containers[i] is the container path[i] is looked up in, and
+	// children[i] what was found there, or nullptr if it is added.
+	std::vector<Value*> containers, children;
+	std::vector<unsigned long long> indexes;	// The element each array step names.
+	Value* at = v;
+	for(std::size_t i = 0; i < path.size(); ++i) {
+		std::string const& key = path[i];
+		bool last = i + 1 == path.size();
+		Value* child = nullptr;
+		unsigned long long index = 0;
 
-			Filter f(args);
-			o->values[s]->accept(f);
+		if(at->type == Type::Object) {
+			child = static_cast<Object*>(at)->find(key);
+			if(!child && !value)	// Nothing to remove.
+				return v;
+		} else if(at->type == Type::Array) {
+			Array* a = static_cast<Array*>(at);
+			// Array elements are named by their index, or by the array's
+			// size to append a new element.
+			char* end = nullptr;
+			index = std::strtoull(key.c_str(), &end, 10);
+			bool number = !key.empty() && *end == '\0';
+			if(!value && (!number || index >= a->size))	// Nothing to remove.
+				return v;
+			if(!number || index > a->size || (index == a->size && !last))
+				throw std::out_of_range("No element " + key + " in array.");
+			if(index < a->size)
+				child = a->values[index];
+		} else {
+			if(!value)	// Nothing to remove below a plain value.
+				return v;
+			throw std::out_of_range("Cannot look up " + key + " in a value that is not an object or array.");
+		}
 
-			object->insertOrder.push_back(s); // Add the key value for this pair.
-			object->values[s] = o->values[s]; // Add the value to the pair.
+		containers.push_back(at);
+		children.push_back(child);
+		indexes.push_back(index);
+		// Missing keys are added, with empty objects for the rest of the path.
+		at = child ? child : arena.create<Object>();
+	}
 
-		} else {								
-			// Key does not match an argument.
-			Filter f(args);				// Filter the value to see if it contains an argument at a deeper level.
-			o->values[s]->accept(f);
+	Value* changed = value;
+	for(std::size_t i = path.size(); i-- > 0; ) {
+		std::string const& key = path[i];
+		Value* child = children[i];
+		if(child && changed == child)
+			return v;	// Nothing above this changes either.
 
-			if(f.result) {				// Value contains argument at a lower level.
-				object->insertOrder.push_back(s);	// Add the result returned by the filter to the new object.
-				object->values[s] = f.result;
+		if(containers[i]->type == Type::Object) {
+			Object* o = static_cast<Object*>(containers[i]);
+			std::vector<Member> members(o->members, o->members + o->size);
+			if(!child) {
+				Member m;
+				Slice text = { key.data(), key.size() };
+				m.key = target.keys.intern(arena, text);
+				m.value = changed;
+				members.push_back(m);
+			} else {
+				for(std::size_t j = 0; j < members.size(); ++j) {
+					if(members[j].key->text == key) {
+						if(changed)
+							members[j].value = changed;
+						else
+							members.erase(members.begin() + j);
+						break;
+					}
+				}
 			}
+			Object* copy = arena.create<Object>();
+			copy->assign(arena, members.data(), members.size());
+			changed = copy;
+		} else {
+			Array* a = static_cast<Array*>(containers[i]);
+			std::vector<Value*> values(a->values, a->values + a->size);
+			if(!child)
+				values.push_back(changed);
+			else if(changed)
+				values[indexes[i]] = changed;
+			else
+				values.erase(values.begin() + std::ptrdiff_t(indexes[i]));
+			Array* copy = arena.create<Array>();
+			copy->size = values.size();
+			copy->values = arena.allocateArray<Value*>(values.size());
+			std::copy(values.begin(), values.end(), copy->values);
+			changed = copy;
 		}
 	}
+	return changed;
+}
 
-	if(object->insertOrder.empty()) 	// If no elements are found that match the arguments
-		delete object;					// Delete the empty object.
-	else
-		result = object;				// Otherwise, set the object as the result for this filter.
+// Postcondition: The value at path is value's value. Every document
+//			that shared values with this one is unchanged.
+void json::Document::set(std::vector<std::string> const& path, Document const& value) {
+	// Hold on to the value first, since it may be this document.
+	Document tree = value;
+	tree.unflatten();
+	unflatten();
+	std::shared_ptr<Storage> source = tree.store;
+	Value* v = tree.head;
+
+	Storage& target = writable();
+	if(!v)
+		v = &Null::instance;	// Blank documents are set as null.
+	head = head ? update(head, path, v, target)
+			: update(target.arena.create<Object>(), path, v, target);
+	if(source && source != store)
+		keep(source);	// The new value is shared, not copied.
 }
-void json::Document::Filter::visit(Array* a) {
-	Array* array = new Array();
 
-	for(Value* v : a->values) {	// Iterate through each value contained by a.
-		Filter f(args);
-		v->accept(f);			// Filter each element.
+// Postcondition: The value at path, if any, has been removed. Every
+//			document that shared values with this one is unchanged.
+void json::Document::erase(std::vector<std::string> const& path) {
+	unflatten();
+	if(!head || path.empty())
+		return;
+	head = update(head, path, nullptr, writable());
+}
 
-		if(f.result) 			// If filter finds a result, add it to the new array.
-			array->values.push_back(f.result);
-	}
+// Creates a Writer to navigate the
+// document's Value pointer.
+// Postcondition: Returns a string in legal json format
+//			that represents this Json Document.
+std::string json::Document::output(Format f) const {
+	StatsTimer t(StatsCollector::OutputNanos);
+	Writer w(f);
+	if(flat)
+		w.write(flat->root());
+	else if(head)
+		w.write(head);
+	return w.take();	// Empty if head is not defined.
+}
 
-	if(array->values.empty()) 	// If no elements are found
-		delete array;			// Delete the empty array.
-	else
-		result = array;			// Otherwise, set the array as the result for this filter.
+std::string json::Document::binary() const {
+	if(flat)
+		return flat->serialize();
+	return Tape::build(head)->serialize();
 }
-void json::Document::Filter::visit(True* t) { }
-void json::Document::Filter::visit(False* f) { }
-void json::Document::Filter::visit(Null* n) { }
-void json::Document::Filter::visit(Number* n) { }
 
 //*****************************
-// Exporter member functions
+// Filter member functions
 //*****************************
 
-void json::Document::Exporter::visit(String* s) { 
-	output += '\"' + s->value + '\"';
-}
-void json::Document::Exporter::visit(Object* o) {
-	output += '{';
-	for(auto it = o->insertOrder.begin(); it != o->insertOrder.end();) {
-		output += '\"' + *it + "\": ";
-		o->values[*it]->accept(*this);
+// Objects and arrays are filtered on an explicit stack rather than by
+// recursion, so no depth of nesting can run out of stack. Each keeps
+// what has been found in it on members or values until its last
+// member or element has been looked at.
+json::Value* json::Document::Filter::run(Value* v) {
+	if(v->type != Type::Object && v->type != Type::Array)
+		return nullptr;	// Only objects and arrays can hold a key.
+	Frame first = { v, 0, 0 };
+	frames.push_back(first);
 
-		it++;
-		if(it != o->insertOrder.end())
-			output += ", ";
-	} 
-	output += '}';
-}
-void json::Document::Exporter::visit(Array* a) { 
-	output += '[';
-	for(auto it = a->values.begin(); it != a->values.end();) {
-		(*it)->accept(*this);
+	for(;;) {
+		Frame& f = frames.back();
+		Value* child = nullptr;
+		if(f.container->type == Type::Object) {
+			Object* o = static_cast<Object*>(f.container);
+			if(f.next < o->size) {	// Iterate through each key value of o.
+				Member& m = o->members[f.next++];
+				if(std::find(keys.begin(), keys.end(), m.key) != keys.end())
+					members.push_back(m);	// Key matches an argument; add the pair as it is.
+				else	// Filter the value to see if it contains an argument at a deeper level.
+					child = m.value;
+			}
+		} else {
+			Array* a = static_cast<Array*>(f.container);
+			if(f.next < a->size)	// Filter each element.
+				child = a->values[f.next++];
+		}
 
-		it++;
-		if(it != a->values.end())
-			output += ", ";
+		if(child) {
+			if(child->type == Type::Object) {
+				Frame next = { child, 0, members.size() };
+				frames.push_back(next);
+			} else if(child->type == Type::Array) {
+				Frame next = { child, 0, values.size() };
+				frames.push_back(next);
+			}
+			continue;
+		}
+		bool finished = f.container->type == Type::Object
+				? f.next == static_cast<Object*>(f.container)->size
+				: f.next == static_cast<Array*>(f.container)->size;
+		if(!finished)
+			continue;
+
+		// Only build an object or array if something was found in it.
+		Value* result = nullptr;
+		if(f.container->type == Type::Object) {
+			if(members.size() > f.base) {
+				Object* object = arena.create<Object>();
+				object->assign(arena, members.data() + f.base, members.size() - f.base);
+				result = object;
+			}
+			members.resize(f.base);
+		} else {
+			if(values.size() > f.base) {
+				Array* array = arena.create<Array>();
+				array->size = values.size() - f.base;
+				array->values = arena.allocateArray<Value*>(array->size);
+				std::copy(values.begin() + f.base, values.end(), array->values);
+				result = array;
+			}
+			values.resize(f.base);
+		}
+		frames.pop_back();
+
+		if(frames.empty())
+			return result;
+		if(!result)
+			continue;
+		// Add the result to the object or array it was found in.
+		Frame& parent = frames.back();
+		if(parent.container->type == Type::Object) {
+			Member r;
+			r.key = static_cast<Object*>(parent.container)->members[parent.next - 1].key;
+			r.value = result;
+			members.push_back(r);
+		} else {
+			values.push_back(result);
+		}
 	}
-	output += ']';
-}
-void json::Document::Exporter::visit(True* t) { 
-	output += "true";
-}
-void json::Document::Exporter::visit(False* f) { 
-	output += "false";
-}
-void json::Document::Exporter::visit(Null* n) { 
-	output += "null";
-}
-void json::Document::Exporter::visit(Number* n) { 
-	output += n->value;
 }
 
 //*****************************
 // Duplicator member functions
 //*****************************
 
-void json::Document::Duplicator::visit(String* s) {
-	String* news = new String();
-	news->value = s->value;
-	copy = news;
-}
-void json::Document::Duplicator::visit(Object* o) {
-	Object* newo = new Object();
-
-	for(auto it = o->insertOrder.begin(); it != o->insertOrder.end(); ++it) {
-		// Make a duplicator for each value, and add the copied value to the new object.
-		Duplicator d;
-		o->values[*it]->accept(d);
-		newo->insertOrder.push_back(*it);
-		newo->values[*it] = d.copy;
+// Objects and arrays are copied on an explicit stack rather than by
+// recursion. An object or array's copy is made as soon as it is
+// reached, so it can be put in its parent straight away, and its
+// members or elements are filled in as they are copied.
+json::Value* json::Document::Duplicator::run(Value* v) {
+	Value* copy = start(v);
+	while(!frames.empty()) {
+		Frame& f = frames.back();
+		if(f.source->type == Type::Object) {
+			Object* o = static_cast<Object*>(f.source);
+			if(f.next == o->size) {
+				frames.pop_back();
+				continue;
+			}
+			std::size_t i = f.next++;
+			Object* newo = static_cast<Object*>(f.copy);
+			newo->members[i].key = target.keys.intern(arena, o->members[i].key->text);
+			newo->members[i].value = start(o->members[i].value);	// f is not used past here.
+		} else {
+			Array* a = static_cast<Array*>(f.source);
+			if(f.next == a->size) {
+				frames.pop_back();
+				continue;
+			}
+			std::size_t i = f.next++;
+			Array* newa = static_cast<Array*>(f.copy);
+			newa->values[i] = start(a->values[i]);
+		}
 	}
-
-	copy = newo;
+	return copy;
 }
-void json::Document::Duplicator::visit(Array* a) {
-	Array* newa = new Array();
 
-	for(auto it = a->values.begin(); it != a->values.end(); ++it) {
-		// Make a duplicator for each value, and add the copied value to the new array.
-		Duplicator d;
-		(*it)->accept(d);
-		newa->values.push_back(d.copy);
+json::Value* json::Document::Duplicator::start(Value* v) {
+	switch(v->type) {
+		case Type::String: return String::make(arena, static_cast<String*>(v)->value);
+		case Type::Number: return Number::make(arena, static_cast<Number*>(v)->value);
+		case Type::True:
+		case Type::False:
+		case Type::Null:  return v;	// Literals are shared by every document.
+		case Type::Object: {
+			Object* o = static_cast<Object*>(v);
+			Object* newo = arena.create<Object>();
+			newo->size = o->size;
+			newo->members = arena.allocateArray<Member>(o->size);
+			if(o->index) {	// Member positions do not change, so the hash table is copied as is.
+				newo->slots = o->slots;
+				newo->index = arena.allocateArray<std::uint32_t>(o->slots);
+				std::copy(o->index, o->index + o->slots, newo->index);
+			}
+			Frame f = { v, newo, 0 };
+			frames.push_back(f);
+			return newo;
+		}
+		default: {
+			Array* a = static_cast<Array*>(v);
+			Array* newa = arena.create<Array>();
+			newa->size = a->size;
+			newa->values = arena.allocateArray<Value*>(a->size);
+			Frame f = { v, newa, 0 };
+			frames.push_back(f);
+			return newa;
+		}
 	}
-
-	copy = newa;
-}
-void json::Document::Duplicator::visit(True* t) {
-	copy = new True();
-}
-void json::Document::Duplicator::visit(False* f) {
-	copy = new False();
-}
-void json::Document::Duplicator::visit(Null* n) {
-	copy = new Null();
-}
-void json::Document::Duplicator::visit(Number* n) {
-	Number* newn = new Number();
-	newn->value = n->value;
-	copy = newn;
 }
 
 // Global operator overload for printing Documents.
 std::ostream& operator<<(std::ostream& os, json::Document& j) {
 	j.print(os);
 	return os;
-}
\ No newline at end of file
+}
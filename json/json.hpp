@@ -3,9 +3,15 @@
 #ifndef JSON_HPP
 #define JSON_HPP
 
-#include <map>
 #include <vector>
+#include <string>
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <memory>
+#include <atomic>
 
 // All of the datastructures and json functions are
 // in this namespace to avoid overlapping of generic
@@ -22,6 +28,111 @@ namespace json {
 	struct False;
 	struct Null;
 	struct Number;
+	class Tape;
+
+	// A Slice is a read-only run of characters stored in an Arena.
+	struct Slice {
+		const char* data;
+		std::size_t size;
+
+		std::string str() const { return std::string(data, size); }
+		std::uint64_t hash() const;
+		bool operator== (Slice const& s) const;
+		bool operator== (std::string const& s) const;
+	};
+
+	/*	The Arena is a bump allocator that owns the memory for
+		every value in a Document, including the characters of
+		its strings and the child lists of its objects and arrays.
+		Values are never freed one at a time; the whole arena is
+		released at once when its Document is destroyed, so none
+		of the value types below may own heap memory of their own.
+	*/
+	class Arena {
+	public:
+		Arena() : blocks(nullptr), cur(nullptr), end(nullptr), used(0) { }
+		~Arena() { release(); }
+
+		Arena(Arena const&) = delete;
+		Arena& operator= (Arena const&) = delete;
+
+		// The common case of fitting in the current block is inline,
+		// since the parser allocates for every value it reads.
+		void* allocate(std::size_t size, std::size_t align) {
+			std::size_t pad = (align - reinterpret_cast<std::size_t>(cur) % align) % align;
+			if(!cur || size + pad > std::size_t(end - cur))
+				return allocateSlow(size, align);
+			char* p = cur + pad;
+			cur = p + size;
+			used += size;
+			return p;
+		}
+		void release();
+		void swap(Arena&);
+
+		// Constructs a T inside the arena.
+		template<class T> T* create() {
+			return new (allocate(sizeof(T), alignof(T))) T();
+		}
+		// Reserves uninitialized space for n values of type T.
+		template<class T> T* allocateArray(std::size_t n) {
+			return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+		}
+		// Copies the given characters into the arena.
+		Slice store(const char*, std::size_t);
+		Slice store(Slice s) { return store(s.data, s.size); }
+
+		// Total number of bytes handed out by this arena.
+		std::size_t bytes() const { return used; }
+
+	private:
+		struct Block {
+			Block* next;
+		};
+		Block* blocks;
+		char* cur;
+		char* end;
+		std::size_t used;
+
+		void* allocateSlow(std::size_t, std::size_t);
+		void grow(std::size_t);
+	};
+
+	// A Key is the single copy of an object key in its Document,
+	// which every member with that key points to.
+	struct Key {
+		Slice text;
+		std::uint64_t hash;	// text.hash(), worked out once.
+	};
+
+	/*	The Keys table interns object keys, so records that repeat
+		the same dozen keys store each of them only once. Two keys
+		from the same table are equal exactly when their pointers
+		are, so comparing them never looks at their characters.
+	*/
+	class Keys {
+	public:
+		Keys() : count(0) { }
+
+		// Returns the key with the given text, adding it if it is new.
+		Key const* intern(Arena&, Slice);
+		// Returns the key with the given text, or nullptr if there is none.
+		Key const* find(Slice) const;
+		std::size_t size() const { return count; }
+
+	private:
+		std::vector<Key const*> slots;	// A power of two long, or empty.
+		std::size_t count;
+
+		std::size_t locate(Slice, std::uint64_t) const;
+		void grow();
+	};
+
+	// A Member is a single key/value pair of an Object.
+	struct Member {
+		Key const* key;
+		Value* value;
+	};
 
 	// A visitor abstract class to perform operations
 	// on different value types.
@@ -37,43 +148,183 @@ namespace json {
 		virtual void visit(Number*) = 0;
 	};	
 
+	/*	A Handler receives a json value as a series of events
+		while it is being parsed, rather than as a finished tree,
+		so a value can be scanned without keeping any of it.
+		Slices passed to a handler point into the parser's input
+		and are only valid for the duration of the call.
+	*/
+	struct Handler {
+		virtual ~Handler() { }
+
+		virtual void onObjectBegin() = 0;
+		virtual void onKey(Slice) = 0;
+		virtual void onObjectEnd() = 0;
+		virtual void onArrayBegin() = 0;
+		virtual void onArrayEnd() = 0;
+		virtual void onString(Slice) = 0;
+		virtual void onNumber(Slice) = 0;
+		virtual void onTrue() = 0;
+		virtual void onFalse() = 0;
+		virtual void onNull() = 0;
+	};
+
+	// The layouts a Document can be written in.
+	//	Pretty:   one value per line, indented two spaces per level, as print writes.
+	//	Spaced:   a single line with a space after each comma and colon, as output writes.
+	//	Minified: a single line with no spaces at all.
+	enum class Format { Pretty, Spaced, Minified };
+
+	// Thrown by the parser when its input is not a complete json value.
+	struct ParseError : std::runtime_error {
+		ParseError(const char* what) : std::runtime_error(what) { }
+	};
+
+	/*	The deepest objects and arrays may be nested in a value being
+		parsed, 10000 unless it is changed. Every parser throws
+		ParseError("nested too deeply") past it, or gives null where it
+		would for any other bad input.
+		Parsing, printing, exporting, filtering, copying and turning
+		trees into tapes and back keep their own stacks rather than
+		recursing, so any depth is safe for them. Queries, stats and
+		diffs still recurse once per level, so the limit is what keeps
+		them safe.
+	*/
+	std::size_t maxDepth();
+	void setMaxDepth(std::size_t);
+
+	// The type of a Value, which every Value keeps in itself.
+	enum class Type : std::uint8_t { String, Object, Array, True, False, Null, Number };
+
+	// Values live in their Document's Arena and are never
+	// deleted individually, so they have no virtual destructor.
+	// They have no virtual functions at all: accept switches on
+	// type, as dispatch below does, so no value carries a vtable.
 	struct Value {
-		virtual ~Value() { }
-		virtual void accept(Visitor&) = 0;
+		const Type type;
+		// Calls the visit function of v that takes the value's type.
+		void accept(Visitor& v);
+	protected:
+		constexpr Value(Type t) : type(t) { }
 	};
 	struct String : Value {
-		std::string value;
-		void accept(Visitor& v) { v.visit(this); }
+	private:
+		char small[7];	// The characters of a short string, which value then points to.
+	public:
+		Slice value;
+		String() : Value(Type::String) { }
+		// value may point into the string itself.
+		String(String const&) = delete;
+		String& operator= (String const&) = delete;
+
+		// Makes a string holding a copy of s in the arena. Strings short
+		// enough to fit in the space a String leaves after its type are
+		// kept there rather than in characters of their own.
+		static String* make(Arena&, Slice s);
 	};
 	struct Object : Value {
-		/* To retain the order of values within an object,
-			I made the vector insertOrder to keep track of
-			the order in which strings were read to the map.
-			This also makes it easier to iterate through the
-			map's values. 
+		/* Members are kept in the order they were read, which is
+			also the order they are printed in. The array itself is
+			allocated in the arena once the object has been fully read.
+			Objects with more than a handful of members also get an
+			open addressing hash table of member positions, so finding
+			a key never means comparing it against every member.
 		*/
-		std::map<std::string, Value*> values;
-		std::vector<std::string> insertOrder;
-		void accept(Visitor& v) { v.visit(this); }
+		Member* members;
+		std::size_t size;
+		std::uint32_t* index;	// Member position + 1 per slot, or 0 if empty.
+		std::size_t slots;		// A power of two, or 0 for small objects.
+		// The structural hash, kept once worked out; 0 until then.
+		mutable std::atomic<std::uint64_t> digest;
+
+		Object() : Value(Type::Object), members(nullptr), size(0), index(nullptr), slots(0), digest(0) { }
+		void assign(Arena&, Member const*, std::size_t);
+		Value* find(Slice key) const;
+		Value* find(std::string const& key) const;
 	};
 	struct Array : Value {
-		std::vector<Value*> values;
-		void accept(Visitor& v) { v.visit(this); }
+		Value** values;
+		std::size_t size;
+		mutable std::atomic<std::uint64_t> digest;	// As for Object.
+		Array() : Value(Type::Array), values(nullptr), size(0), digest(0) { }
 	};
+	// Literals hold nothing but their type, so every document shares
+	// the one instance of each rather than allocating its own.
 	struct True : Value {
-		void accept(Visitor& v) { v.visit(this); }
+		constexpr True() : Value(Type::True) { }
+		static True instance;
 	};
 	struct False : Value {
-		void accept(Visitor& v) { v.visit(this); }
+		constexpr False() : Value(Type::False) { }
+		static False instance;
 	};
 	struct Null : Value {
-		void accept(Visitor& v) { v.visit(this); }
+		constexpr Null() : Value(Type::Null) { }
+		static Null instance;
 	};
 	struct Number : Value {
-		std::string value;
-		void accept(Visitor& v) { v.visit(this); }
+	private:
+		enum Kind : std::uint8_t { Unknown, Signed, Unsigned, Floating, Invalid };
+		mutable std::atomic<std::uint8_t> kind;
+		char small[6];	// The characters of a short number, as for String.
+	public:
+		Slice value;	// The number as it was written, which is what gets exported.
+		Number() : Value(Type::Number), kind(0), bits(0) { }
+
+		// Makes a number holding a copy of s in the arena, as String::make does.
+		static Number* make(Arena&, Slice s);
+
+		/*	The typed accessors decode the text the first time any of
+			them is called and keep the result, so reading the same
+			number again costs a load. Documents are shared between
+			threads, so the cached result is stored atomically.
+			They throw std::range_error if the number does not fit in
+			the requested type, and std::invalid_argument if the text
+			is not a json number at all. For asDouble, that means too
+			big for a double; numbers too small for one round towards
+			zero like any other.
+		*/
+		std::int64_t asInt64() const;
+		std::uint64_t asUint64() const;
+		double asDouble() const;
+
+	private:
+		mutable std::atomic<std::uint64_t> bits;	// The integer, or the double's bits.
+
+		Kind decode() const;
 	};
 
+	/*	Returns a hash of a value's contents, so values that hash the
+		same almost certainly hold the same json. An object hashes the
+		same whatever order its members are in. Strings and numbers are
+		hashed as they were written, so 1 and 1.0 differ.
+		Values never change once they are built, so the hash of every
+		object and array is kept in it the first time it is worked out,
+		and hashing it or anything around it again skips what is inside.
+	*/
+	std::uint64_t structuralHash(Value const*);
+
+	/*	Calls the visit function of v that takes the value's type, by
+		switching on its type, as accept does for any Visitor. When V is
+		final, or its visit functions are not virtual, which function
+		runs is known at compile time, so it can be inlined and a walk
+		over a tree costs no indirect calls at all.
+	*/
+	template<class V> inline void dispatch(Value* value, V& v) {
+		switch(value->type) {
+			case Type::String: v.visit(static_cast<String*>(value)); break;
+			case Type::Object: v.visit(static_cast<Object*>(value)); break;
+			case Type::Array:  v.visit(static_cast<Array*>(value)); break;
+			case Type::True:   v.visit(static_cast<True*>(value)); break;
+			case Type::False:  v.visit(static_cast<False*>(value)); break;
+			case Type::Null:   v.visit(static_cast<Null*>(value)); break;
+			case Type::Number: v.visit(static_cast<Number*>(value)); break;
+		}
+	}
+	inline void Value::accept(Visitor& v) { dispatch(this, v); }
+
+	std::ostream& operator<< (std::ostream&, Slice const&);
+
 	/*	
 	The Document class contains a pointer to the head
 	of the document, as well as public methods for
@@ -86,130 +337,280 @@ namespace json {
 	cannot be manipulated outside of Document's scope.
 	*/
 
+	/*	A Storage holds the arena a Document's values are allocated in.
+		Documents that share values, like the result of a filter and
+		the document it was filtered from, hold shared pointers to the
+		same Storage, and a Storage can also keep the Storage of other
+		documents alive when some of its values live there.
+		Values already in a Storage are never changed or freed until
+		the last Document referring to it is gone.
+		A Storage's shared list holds every Storage it keeps alive,
+		not just the ones it refers to directly, so the storages are
+		never chained more than one level deep.
+		Work split between threads makes a Storage for each thread.
+		Those are the Storage's parts: they belong to it alone, keep
+		nothing else alive, and are not counted as storages it keeps.
+	*/
+	struct Storage {
+		Arena arena;
+		Keys keys;	// Every key of the objects allocated in arena.
+		std::vector<std::shared_ptr<Storage const> > shared;
+		std::vector<std::shared_ptr<Storage const> > parts;
+
+		// Keeps s alive, along with every Storage s keeps alive.
+		void keep(std::shared_ptr<Storage const> const& s);
+	};
+
 	class Document {
+		friend class DocumentBuilder;
 	private:
+		std::shared_ptr<Storage> store;	// Owns, or keeps alive, every Value reachable from head.
 		Value* head;
+		std::shared_ptr<Tape const> flat;	// The whole document, for documents kept as a tape.
 
-		// Private constructor
-		Document(Value* v) : head(v) { } 
+		// The Handler that builds a Document's values as they are read.
+		struct Builder;
+		// The Handler that builds only what a filter would keep.
+		struct FilterBuilder;
 
-		Value* parse(std::istream&);
-		void clrWS(std::istream&);
+		void load(const char*, std::size_t);
+		void read(const char*, std::size_t);
 		
 	public:
 		// Constructors
-		Document() : head(nullptr) { }
-		Document(std::istream& is) : head(parse(is)) { }
-		Document(Document const& doc) {
-			if(doc.head) {
-				Duplicator d;
-				doc.head->accept(d);
-				delete head;
-				head = d.copy;
-			} else {
-				head = nullptr;
-			}
+		Document() : store(std::make_shared<Storage>()), head(nullptr) { }
+		Document(const char* data, std::size_t size) : store(std::make_shared<Storage>()), head(nullptr) {
+			load(data, size);
+		}
+		Document(std::string const& s) : store(std::make_shared<Storage>()), head(nullptr) {
+			load(s.data(), s.size());
 		}
+		// Reads the rest of the istream into a buffer and parses that.
+		Document(std::istream&);
 
-		// Deconstructor
-		~Document() {
-			delete head;
+		// Parses a file by mapping it into memory rather than reading it.
+		// Like the constructor, it reports failures on stderr, so they
+		// never mix with json written to stdout.
+		static Document fromFile(std::string const& path);
+		// Parses like the constructor, but throws ParseError on bad input,
+		// including anything but whitespace after the value, instead of
+		// printing a message on stderr and returning null.
+		static Document parseStrict(const char* data, std::size_t size);
+		// Parses like parseStrict, but keeps the document as a Tape
+		// rather than a tree of Values. print, output, filter, copy and
+		// materialize work on the tape directly; set and erase turn
+		// the document into a tree first.
+		static Document parseTape(const char* data, std::size_t size);
+		// Parses like parseStrict, but splits a large top-level array
+		// between the given number of threads, or one per processor for 0.
+		// Each thread's elements live in a storage of its own, one of the
+		// parts of the document's storage. Anything else is parsed serially.
+		static Document parseParallel(const char* data, std::size_t size, unsigned threads = 0);
+		// Parses like parseStrict and filters like filter, in one pass.
+		// Values outside what the filter keeps are read but never
+		// allocated, so the cost of parsing is mostly what is kept.
+		static Document parseFiltered(const char* data, std::size_t size, std::vector<std::string> const& keys);
+		// Make a document from the bytes binary returns, kept as a tape.
+		// fromBinary copies the bytes; loadBinary maps the file into
+		// memory and reads the document straight from it, so nothing
+		// is parsed or built no matter how big it is.
+		// Both throw ParseError if the bytes are not from binary, and
+		// loadBinary throws std::runtime_error if the file cannot be opened.
+		static Document fromBinary(const char* data, std::size_t size);
+		static Document loadBinary(std::string const& path);
+
+		/*	Values are never changed once they are in a Storage, so
+			copies simply share them and cost the same no matter how
+			big the document is. Changing a copy with set or erase
+			only rebuilds the objects and arrays on the path to the
+			change; everything else stays shared.
+		*/
+		Document(Document const& doc) : store(doc.store), head(doc.head), flat(doc.flat) { }
+		Document(Document&& doc) : store(std::move(doc.store)), head(doc.head), flat(std::move(doc.flat)) {
+			doc.head = nullptr;
 		}
 
+		// Deconstructor
+		// Every value lives in an arena, which is released at once
+		// when no Document refers to its Storage any more.
+		~Document() { }
+
 		// Public member functions
+		// The document's top value, for reading; it must not be changed
+		// directly, since other documents may share it. Null if blank
+		// or kept as a tape.
+		Value const* root() const { return head; }
+		// The document's tape, or nullptr if it is kept as a tree.
+		Tape const* tape() const { return flat.get(); }
 		void print(std::ostream&) const;
-		Document filter(std::vector<std::string>&) const;
+		// Writes the document straight to a file descriptor. Throws
+		// std::invalid_argument if fd is negative, and std::runtime_error
+		// if writing to it fails.
+		void print(int fd, Format = Format::Pretty) const;
+		// The filtered document shares this document's values rather
+		// than copying them, and keeps them alive for as long as it lives.
+		// Filters on the calling thread unless given more threads, or 0
+		// for one per processor. Then the members or elements of large
+		// objects and arrays are split between that many threads, started
+		// for the call, and the result is exactly what one thread makes.
+		// Callers already running on a pool of their own should leave it at 1.
+		Document filter(std::vector<std::string>&, unsigned threads = 1) const;
 		Document copy() const;
-		std::string output() const;
+		// The structural hash of the top value, or 0 for a blank document.
+		std::uint64_t hash() const;
+		/*	Returns the changes that turn this document into to, as an
+			array in the form of a JSON Patch (RFC 6902):
+				[{"op": "replace", "path": "/a/0", "value": 2}, ...]
+			using the ops add, remove and replace. Values that hash the
+			same are taken to be equal without looking inside them, so
+			the cost follows the size of the change, not the documents.
+			Arrays are compared element by element after matching up
+			their equal beginnings and ends, so a single insertion or
+			removal is a single change. Added and replaced values are
+			shared with to rather than copied.
+		*/
+		Document diff(Document const& to) const;
+		// Returns a copy that shares no values with any other document.
+		Document materialize() const;
+		std::string output(Format = Format::Spaced) const;
+		// The document in the binary form described at Tape::serialize.
+		std::string binary() const;
+
+		// Follows path through objects by key and arrays by index, and
+		// sets the value found there to a copy of the given document.
+		// Missing keys are added, creating objects along the way.
+		// Throws std::out_of_range if path runs into anything else.
+		void set(std::vector<std::string> const& path, Document const& value);
+		// Removes the member or element at the end of path, if there is one.
+		void erase(std::vector<std::string> const& path);
 
 		// Overloaded operator=
 		Document& operator= (Document const& doc) {
-			if(doc.head) {
-				Duplicator d;
-				doc.head->accept(d);
-
-				delete head;	// Free any space before reassigning head pointer.
-				head = d.copy;
-			} else {
-				delete head;
-				head = nullptr;
+			store = doc.store;	// Safe even for self-assignment.
+			head = doc.head;
+			flat = doc.flat;
+			return *this;
+		}
+		Document& operator= (Document&& doc) {
+			if(this != &doc) {
+				store = std::move(doc.store);
+				head = doc.head;
+				flat = std::move(doc.flat);
+				doc.head = nullptr;
 			}
 			return *this;
 		}
 
-		// Declarations for visitor structures
 	private:
-		// The Printer visitor is used for outputting any value
-		// to a given ostream in proper 'pretty print' format.
-		struct Printer : Visitor {
-			std::ostream& os;
-			int tab;
-			Printer(std::ostream& o) : os(o), tab(0) { }
-
-			void visit(String*);
-			void visit(Object*);
-			void visit(Array*);
-			void visit(True*);
-			void visit(False*);
-			void visit(Null*);
-			void visit(Number*);
-
-			void printTabs();
-		};
+		Storage& writable();
+		void keep(std::shared_ptr<Storage const> const&);
+		void unflatten();
+		static Value* update(Value*, std::vector<std::string> const&, Value*, Storage&);
 
-		// The Filter visitor is used for finding objects that
+		// Declarations for visitor structures
+	private:
+		// The Filter is used for finding objects that
 		// contain a given list of key values
-		struct Filter : Visitor {
-			Value* result;
-			std::vector<std::string>& args;
-			Filter(std::vector<std::string>& a) : result(nullptr), args(a) { }
-
-			void visit(String*);
-			void visit(Object*);
-			void visit(Array*);
-			void visit(True*);
-			void visit(False*);
-			void visit(Null*);
-			void visit(Number*);
-		};
+		// The result shares the original document's values, and any
+		// new objects or arrays are allocated in the given arena.
+		// Keys are matched by pointer, against every interned copy
+		// of every argument in the storages the document refers to.
+		struct Filter {
+			std::vector<Key const*> const& keys;
+			Arena& arena;
+			Filter(std::vector<Key const*> const& k, Arena& ar) : keys(k), arena(ar) { }
+
+			// Returns what is left of v, or nullptr if nothing matched.
+			Value* run(Value* v);
 
-		// The Exporter visitor is used for creating a string 
-		// representation for a json document in proper json format.
-		struct Exporter : Visitor {
-			std::string output;
-
-			void visit(String*);
-			void visit(Object*);
-			void visit(Array*);
-			void visit(True*);
-			void visit(False*);
-			void visit(Null*);
-			void visit(Number*);
+		private:
+			// An object or array whose members or elements are being filtered.
+			struct Frame {
+				Value* container;
+				std::size_t next;	// The member or element to look at next.
+				std::size_t base;	// Where its results start on members or values.
+			};
+			std::vector<Frame> frames;
+			// What has been kept of the open objects and arrays so far.
+			std::vector<Member> members;
+			std::vector<Value*> values;
 		};
 
-		// The Duplicator visitor is used for creating a copy
-		// of a Value. This is used in the big 3.
-			// This visitor was a challenge to implement, as I had to
+		// Filters like the Filter, but hands the members or elements of
+		// large objects and arrays near the top to a pool of threads.
+		struct Splitter;
+
+		// The Duplicator is used for creating a copy
+		// of a Value. This is used by materialize.
+			// This was a challenge to implement, as I had to
 			// try to make sure no memory would be leaked and that
 			// documents would not share pointers to the same values.
-		struct Duplicator : Visitor {
-			Value* copy;
-
-			Duplicator() : copy(nullptr) { }
-
-			void visit(String*);
-			void visit(Object*);
-			void visit(Array*);
-			void visit(True*);
-			void visit(False*);
-			void visit(Null*);
-			void visit(Number*);
+			// Every copied value is allocated in the destination storage.
+		struct Duplicator {
+			Storage& target;
+			Arena& arena;
+			Duplicator(Storage& t) : target(t), arena(t.arena) { }
+
+			// Returns a copy of v and everything in it.
+			Value* run(Value* v);
+
+		private:
+			// An object or array whose copy is being filled in.
+			struct Frame {
+				Value* source;
+				Value* copy;
+				std::size_t next;
+			};
+			std::vector<Frame> frames;
+
+			// Copies v, leaving an object or array empty and on frames to be filled in.
+			Value* start(Value* v);
 		};
 
 	};
 
+	/*	A DocumentBuilder is a Handler that builds a Document out of
+		the events it is given, so a Document can be made by any parser
+		that reports to a Handler, like the PushParser.
+	*/
+	class DocumentBuilder final : public Handler {
+	public:
+		DocumentBuilder();
+		~DocumentBuilder();
+
+		DocumentBuilder(DocumentBuilder const&) = delete;
+		DocumentBuilder& operator= (DocumentBuilder const&) = delete;
+
+		void onObjectBegin();
+		void onKey(Slice);
+		void onObjectEnd();
+		void onArrayBegin();
+		void onArrayEnd();
+		void onString(Slice);
+		void onNumber(Slice);
+		void onTrue();
+		void onFalse();
+		void onNull();
+
+		// Returns the document built from every event so far, and starts
+		// a new one. Throws ParseError if the value is not complete yet.
+		Document document();
+
+	private:
+		Document doc;
+		std::unique_ptr<Document::Builder> builder;
+	};
+
 	// Function designed for more flexibility in parsing json objects.
 	Document parse(std::istream&);
+	Document parse(const char*, std::size_t);
+
+	// Functions that report a value to a Handler without building a Document.
+	// Parsing a file maps it into memory, so only the pages being read at
+	// the moment need to be resident.
+	// These throw ParseError if the input is not a complete json value.
+	void parse(const char*, std::size_t, Handler&);
+	void parseFile(std::string const& path, Handler&);
 };
 
 // Global operator overload for printing Documents.
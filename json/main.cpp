@@ -1,29 +1,75 @@
 // Douglas Keller
 
 #include "json.hpp"
+#include "ndjson.hpp"
+#include "pool.hpp"
+#include "stats.hpp"
 #include <iostream>
 #include <vector>
+#include <cstdlib>
+#include <memory>
 
 using namespace std;
 using namespace json;
 
 int main(int argc, char** argv) {
-	if(argc > 1) {
+	// Options start with --; every other argument is a key to filter for.
+	bool lines = false;
+	bool stats = false;
+	unsigned threads = Pool::defaultThreads();
+	vector<string> args;
+	for(int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if(arg == "--ndjson")
+			lines = true;
+		else if(arg == "--stats")
+			stats = true;
+		else if(arg.compare(0, 10, "--threads=") == 0)
+			threads = unsigned(atoi(arg.c_str() + 10));
+		else
+			args.push_back(arg);
+	}
+
+	// Stats go to stderr once everything else is written, so they
+	// never mix with the output.
+	if(stats && !StatsCollector::enabled)
+		cerr << "json was built without JSON_STATS, so --stats has nothing to report." << endl;
+	// Only made when asked for, since collecting costs a count of every document's values.
+	unique_ptr<StatsCollector> collector;
+	if(stats)
+		collector.reset(new StatsCollector);
+
+	if(lines) {
+		// Newline-delimited json: one document per line, written back one per line.
+		processLines(cin, cout, args, threads);
+
+	} else if(!args.empty()) {
 		cout << "Filtering Json Document for the following key values:\n\t";
-		for(int i = 1; i < argc; ++i) 
-			cout << argv[i] << "    ";
+		for(string& a : args)
+			cout << a << "    ";
 		cout << '\n';
 
-		// Create a vector of all arguments excluding the command
-		vector<string> args(argv + 1, argv + argc);
-
-		Document j(cin);
-		Document f = j.filter(args);
+		// Only what the filter keeps is built, as the input is parsed.
+		string input;
+		char chunk[1 << 16];
+		while(cin.read(chunk, sizeof(chunk)) || cin.gcount())
+			input.append(chunk, size_t(cin.gcount()));
+		Document f;
+		try {
+			f = Document::parseFiltered(input.data(), input.size(), args);
+		} catch (ParseError&) {
+			cerr << "Unable to parse input." << endl;
+		}
 
 		cout << f << endl;
-		
+
 	} else {
 		Document j(cin);
 		cout << j << endl;
 	}
-}
\ No newline at end of file
+
+	if(stats && StatsCollector::enabled) {
+		collector->stats().write(cerr);
+		cerr << endl;
+	}
+}
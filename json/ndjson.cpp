@@ -0,0 +1,143 @@
+// Douglas Keller
+
+#include "ndjson.hpp"
+#include "json.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+namespace {
+	// Input is read in blocks of about this many bytes, and the
+	// complete lines of each block become one batch.
+	const std::size_t batchBytes = 1 << 20;
+
+	// How many batches each worker may have queued or finished
+	// but not yet written, which bounds memory use.
+	const std::size_t batchesPerThread = 4;
+
+	struct Batch {
+		std::size_t firstLine;	// Line number of the batch's first line, for error messages.
+		std::string input;
+		std::string output;
+		std::string errors;
+	};
+
+	// Finished batches wait here until every batch before them has been written.
+	class ReorderBuffer {
+	public:
+		ReorderBuffer() : next(0) { }
+
+		void put(std::size_t seq, std::shared_ptr<Batch> b) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				finished[seq] = b;
+			}
+			done.notify_all();
+		}
+
+		// Waits for the next batch in input order to finish, then writes it.
+		void writeNext(std::ostream& out) {
+			std::shared_ptr<Batch> b;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				done.wait(guard, [this] { return finished.count(next) != 0; });
+				b = finished[next];
+				finished.erase(next++);
+			}
+			out.write(b->output.data(), std::streamsize(b->output.size()));
+			std::cerr << b->errors;
+		}
+
+	private:
+		std::mutex lock;
+		std::condition_variable done;
+		std::map<std::size_t, std::shared_ptr<Batch> > finished;
+		std::size_t next;
+	};
+
+	// Parses, filters and exports every line of a batch.
+	void process(Batch& b, std::vector<std::string> const& args) {
+		const char* p = b.input.data();
+		const char* end = p + b.input.size();
+		for(std::size_t line = b.firstLine; p < end; ++line) {
+			const char* nl = static_cast<const char*>(std::memchr(p, '\n', std::size_t(end - p)));
+			const char* last = nl ? nl : end;
+			std::size_t length = std::size_t(last - p);
+			if(length && last[-1] == '\r')
+				--length;
+
+			// Blank lines hold no record.
+			if(std::find_if(p, p + length, [](char c) { return c != ' ' && c != '\t'; }) != p + length) {
+				try {
+					std::string record = args.empty() ? json::Document::parseStrict(p, length).output()
+							: json::Document::parseFiltered(p, length, args).output();
+					if(!record.empty()) {
+						b.output += record;
+						b.output += '\n';
+					}
+				} catch (std::exception& e) {	// Out of memory or too long, as well as bad json.
+					b.errors += "Unable to parse line " + std::to_string(line) + ": " + e.what() + '\n';
+				}
+			}
+			p = last + 1;
+		}
+	}
+}
+
+//Precondition:  The istream holds newline-delimited json.
+//Postcondition: Every record has been written to the ostream in input order.
+void json::processLines(std::istream& is, std::ostream& os, std::vector<std::string> const& args, unsigned threads) {
+	ReorderBuffer reorder;
+	Pool pool(threads);
+	std::size_t limit = batchesPerThread * (threads ? threads : 1);
+	std::size_t submitted = 0, written = 0;
+	std::size_t line = 1;
+
+	std::string carry;	// A partial line left over from the previous block.
+	std::vector<char> chunk(batchBytes);
+	bool eof = false;
+	while(!eof) {
+		std::shared_ptr<Batch> b = std::make_shared<Batch>();
+		b->input.swap(carry);
+
+		// Read until the batch is big enough and ends in a complete line.
+		std::size_t nl = std::string::npos;
+		while(!eof && (b->input.size() < batchBytes || nl == std::string::npos)) {
+			is.read(chunk.data(), std::streamsize(chunk.size()));
+			eof = is.gcount() == 0;
+			b->input.append(chunk.data(), std::size_t(is.gcount()));
+			nl = b->input.rfind('\n');
+		}
+		if(!eof && nl != std::string::npos) {
+			carry.assign(b->input, nl + 1, std::string::npos);
+			b->input.resize(nl + 1);
+		}
+		if(b->input.empty())
+			break;
+
+		b->firstLine = line;
+		line += std::size_t(std::count(b->input.begin(), b->input.end(), '\n'));
+
+		std::size_t seq = submitted++;
+		pool.submit([b, seq, &args, &reorder] {
+			process(*b, args);
+			reorder.put(seq, b);
+		});
+
+		// Write finished batches before reading too far ahead.
+		while(submitted - written >= limit) {
+			reorder.writeNext(os);
+			++written;
+		}
+	}
+
+	while(written < submitted) {
+		reorder.writeNext(os);
+		++written;
+	}
+	os.flush();
+}
@@ -0,0 +1,26 @@
+// Douglas Keller
+
+#ifndef NDJSON_HPP
+#define NDJSON_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace json {
+
+	/*	Reads newline-delimited json from the istream, one document
+		per line, and writes each document to the ostream on a line
+		of its own, in the order it was read. When args is not empty,
+		each document is filtered for those keys first, and documents
+		with no matching keys are left out.
+
+		Lines are handed to a pool of worker threads in batches, and
+		finished batches wait in a reorder buffer until every batch
+		before them has been written. Lines that are not valid json
+		are reported on stderr and skipped.
+	*/
+	void processLines(std::istream&, std::ostream&, std::vector<std::string> const& args, unsigned threads);
+};
+
+#endif
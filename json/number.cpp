@@ -0,0 +1,244 @@
+// Douglas Keller
+
+#include "json.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+namespace {
+	inline bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	// Powers of ten that a double holds exactly.
+	const double exactPowers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	std::uint64_t toBits(double d) {
+		std::uint64_t b;
+		std::memcpy(&b, &d, sizeof(b));
+		return b;
+	}
+	double fromBits(std::uint64_t b) {
+		double d;
+		std::memcpy(&d, &b, sizeof(d));
+		return d;
+	}
+
+	// The slow path for floating point text: strtod rounds correctly,
+	// but it needs a terminated copy of the text.
+	double slowDouble(json::Slice s) {
+		char small[64];
+		std::string large;
+		const char* text = small;
+		if(s.size < sizeof(small)) {
+			std::memcpy(small, s.data, s.size);
+			small[s.size] = '\0';
+		} else {
+			large.assign(s.data, s.size);
+			text = large.c_str();
+		}
+		return std::strtod(text, nullptr);
+	}
+}
+
+//*****************************
+// Number member functions
+//*****************************
+
+json::Number* json::Number::make(Arena& arena, Slice s) {
+	Number* num = arena.create<Number>();
+	if(s.size <= sizeof(num->small)) {
+		std::memcpy(num->small, s.data, s.size);
+		num->value.data = num->small;
+		num->value.size = s.size;
+	} else {
+		num->value = arena.store(s);
+	}
+	return num;
+}
+
+// Reads the number's text once, checks that it is a json number,
+// and caches its value in the narrowest form that holds it exactly.
+// Postcondition: Returns the number's kind, which is never Unknown.
+json::Number::Kind json::Number::decode() const {
+	std::uint8_t k = kind.load(std::memory_order_acquire);
+	if(k != Unknown)
+		return Kind(k);
+
+	const char* p = value.data;
+	const char* end = p + value.size;
+	bool negative = p != end && *p == '-';
+	if(negative)
+		++p;
+
+	// The integer part must be 0 or start with a non-zero digit.
+	if(p == end || !isDigit(*p) || (*p == '0' && p + 1 != end && isDigit(p[1]))) {
+		kind.store(Invalid, std::memory_order_release);
+		return Invalid;
+	}
+
+	// Up to 19 digits always fit in 64 bits. Any digits past that
+	// only raise the exponent, and make the mantissa inexact.
+	std::uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool exact = true;
+	bool integer = true;
+	bool overflow = false;	// The integer part does not fit in 64 bits.
+	std::uint64_t whole = 0;
+
+	for(; p != end && isDigit(*p); ++p) {
+		unsigned d = unsigned(*p - '0');
+		if(!overflow) {
+			if(whole > (std::numeric_limits<std::uint64_t>::max() - d) / 10)
+				overflow = true;
+			else
+				whole = whole * 10 + d;
+		}
+		if(digits < 19) {
+			mantissa = mantissa * 10 + d;
+			if(mantissa)
+				++digits;
+		} else {
+			++exponent;
+			exact = exact && d == 0;
+		}
+	}
+	if(p != end && *p == '.') {
+		integer = false;
+		if(++p == end || !isDigit(*p)) {
+			kind.store(Invalid, std::memory_order_release);
+			return Invalid;
+		}
+		for(; p != end && isDigit(*p); ++p) {
+			unsigned d = unsigned(*p - '0');
+			if(digits < 19) {
+				mantissa = mantissa * 10 + d;
+				if(mantissa)
+					++digits;
+				--exponent;
+			} else {
+				exact = exact && d == 0;
+			}
+		}
+	}
+	if(p != end && (*p == 'e' || *p == 'E')) {
+		integer = false;
+		++p;
+		bool down = p != end && *p == '-';
+		if(p != end && (*p == '-' || *p == '+'))
+			++p;
+		if(p == end || !isDigit(*p)) {
+			kind.store(Invalid, std::memory_order_release);
+			return Invalid;
+		}
+		int e = 0;
+		for(; p != end && isDigit(*p); ++p)
+			if(e < 100000)	// Far past the range of a double either way.
+				e = e * 10 + (*p - '0');
+		exponent += down ? -e : e;
+	}
+	if(p != end) {
+		kind.store(Invalid, std::memory_order_release);
+		return Invalid;
+	}
+
+	// The fast path for plain integers.
+	Kind result = Floating;
+	if(integer && !overflow) {
+		const std::uint64_t limit = std::uint64_t(std::numeric_limits<std::int64_t>::max());
+		if(!negative && whole <= limit) {
+			bits.store(whole, std::memory_order_relaxed);
+			result = Signed;
+		} else if(negative && whole <= limit + 1) {
+			bits.store(~whole + 1, std::memory_order_relaxed);	// Two's complement of the magnitude.
+			result = Signed;
+		} else if(!negative) {
+			bits.store(whole, std::memory_order_relaxed);
+			result = Unsigned;
+		}
+	}
+
+	if(result == Floating) {
+		// A mantissa and power of ten that are both exact doubles give a
+		// correctly rounded result with one multiply or divide.
+		double d;
+		if(exact && mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+			d = double(mantissa);
+			d = exponent < 0 ? d / exactPowers[-exponent] : d * exactPowers[exponent];
+			if(negative)
+				d = -d;
+		} else {
+			d = slowDouble(value);
+		}
+		bits.store(toBits(d), std::memory_order_relaxed);
+	}
+
+	kind.store(result, std::memory_order_release);
+	return result;
+}
+
+// Postcondition: Returns the number as a signed 64 bit integer.
+std::int64_t json::Number::asInt64() const {
+	switch(decode()) {
+		case Signed:
+			return std::int64_t(bits.load(std::memory_order_relaxed));
+		case Floating: {
+			// Numbers written like 1e3 or 2.0 are still whole numbers.
+			double d = fromBits(bits.load(std::memory_order_relaxed));
+			if(d == std::trunc(d) && d >= -9223372036854775808.0 && d < 9223372036854775808.0)
+				return std::int64_t(d);
+			throw std::range_error("Number does not fit in a signed 64 bit integer.");
+		}
+		case Invalid:
+			throw std::invalid_argument("Not a json number.");
+		default:
+			throw std::range_error("Number does not fit in a signed 64 bit integer.");
+	}
+}
+
+// Postcondition: Returns the number as an unsigned 64 bit integer.
+std::uint64_t json::Number::asUint64() const {
+	switch(decode()) {
+		case Signed: {
+			std::int64_t i = std::int64_t(bits.load(std::memory_order_relaxed));
+			if(i < 0)
+				throw std::range_error("Negative number does not fit in an unsigned integer.");
+			return std::uint64_t(i);
+		}
+		case Unsigned:
+			return bits.load(std::memory_order_relaxed);
+		case Floating: {
+			double d = fromBits(bits.load(std::memory_order_relaxed));
+			if(d == std::trunc(d) && d >= 0 && d < 18446744073709551616.0)
+				return std::uint64_t(d);
+			throw std::range_error("Number does not fit in an unsigned 64 bit integer.");
+		}
+		default:
+			throw std::invalid_argument("Not a json number.");
+	}
+}
+
+// Postcondition: Returns the double closest to the number; throws
+//			std::range_error if it is too big for a double.
+double json::Number::asDouble() const {
+	switch(decode()) {
+		case Signed:
+			return double(std::int64_t(bits.load(std::memory_order_relaxed)));
+		case Unsigned:
+			return double(bits.load(std::memory_order_relaxed));
+		case Floating: {
+			// json has no infinity, so one only comes from text too big for a double.
+			double d = fromBits(bits.load(std::memory_order_relaxed));
+			if(std::isinf(d))
+				throw std::range_error("Number does not fit in a double.");
+			return d;
+		}
+		default:
+			throw std::invalid_argument("Not a json number.");
+	}
+}
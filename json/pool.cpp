@@ -0,0 +1,65 @@
+// Douglas Keller
+
+#include "pool.hpp"
+
+//*****************************
+// Pool member functions
+//*****************************
+
+json::Pool::Pool(unsigned threads) : unfinished(0), stopping(false) {
+	if(threads == 0)
+		threads = 1;
+	for(unsigned i = 0; i < threads; ++i)
+		workers.push_back(std::thread(&Pool::work, this));
+}
+
+// Postcondition: Every submitted task has run and every worker has exited.
+json::Pool::~Pool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	ready.notify_all();
+	for(std::thread& t : workers)
+		t.join();
+}
+
+void json::Pool::submit(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		tasks.push_back(std::move(task));
+		++unfinished;
+	}
+	ready.notify_one();
+}
+
+void json::Pool::wait() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this] { return unfinished == 0; });
+}
+
+unsigned json::Pool::defaultThreads() {
+	unsigned n = std::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+// Each worker takes tasks off the front of the queue until the
+// pool is stopping and there is nothing left to run.
+void json::Pool::work() {
+	for(;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [this] { return stopping || !tasks.empty(); });
+			if(tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+
+		std::lock_guard<std::mutex> guard(lock);
+		if(--unfinished == 0)
+			idle.notify_all();
+	}
+}
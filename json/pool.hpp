@@ -0,0 +1,46 @@
+// Douglas Keller
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace json {
+
+	// A fixed set of worker threads that run submitted tasks
+	// in the order they were submitted. The destructor waits
+	// for every task that has been submitted to finish.
+	class Pool {
+	public:
+		Pool(unsigned threads);
+		~Pool();
+
+		Pool(Pool const&) = delete;
+		Pool& operator= (Pool const&) = delete;
+
+		void submit(std::function<void()>);
+		// Waits until every task submitted so far has finished.
+		void wait();
+
+		// The number of threads to use when the caller has no preference.
+		static unsigned defaultThreads();
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()> > tasks;
+		std::mutex lock;
+		std::condition_variable ready;
+		std::condition_variable idle;
+		std::size_t unfinished;		// Tasks submitted but not yet finished.
+		bool stopping;
+
+		void work();
+	};
+};
+
+#endif
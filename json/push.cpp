@@ -0,0 +1,247 @@
+// Douglas Keller
+
+#include "push.hpp"
+#include "reader.hpp"
+#include <cstring>
+
+namespace {
+	bool space(char c) {
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+	}
+	// The characters a bare word runs until, as in Reader::word.
+	bool delimiter(char c) {
+		return space(c) || c == ',' || c == '}' || c == ']' || c == ':';
+	}
+}
+
+//*****************************
+// PushParser member functions
+//*****************************
+
+json::PushParser::PushParser(Handler& h)
+	: handler(h), state(Value), start(nullptr), key(false), escaped(false), limit(maxDepth()) { }
+
+// Postcondition: Every part of the value that could be read from the
+//			piece has been reported, and the rest is kept for later.
+void json::PushParser::feed(const char* data, std::size_t size) {
+	if(state == Failed)
+		throw ParseError("parser has already failed");
+
+	const char* p = data;
+	const char* end = data + size;
+	start = data;	// A string or word left over from the last piece carries on here.
+	while(p != end) {
+		if(state == String) {
+			p = string(p, end);
+			continue;
+		}
+		if(state == Word) {
+			p = word(p, end);
+			continue;
+		}
+		if(state == Done)
+			return;
+
+		char c = *p++;
+		if(space(c))
+			continue;
+
+		switch(state) {
+			case ObjectFirst:
+				if(c == '}') {	// An empty object.
+					close('}');
+					break;
+				}
+				if(c != '\"')
+					fail("expected a key");
+				p = begin(c, p - 1);
+				break;
+			case Key:
+				if(c != '\"')
+					fail("expected a key");
+				p = begin(c, p - 1);
+				break;
+			case Colon:
+				if(c != ':')
+					fail("expected ':'");
+				state = Value;
+				break;
+			case ArrayFirst:
+				if(c == ']') {	// An empty array.
+					close(']');
+					break;
+				}
+				p = begin(c, p - 1);
+				break;
+			case Value:
+				p = begin(c, p - 1);
+				break;
+			default:	// After
+				if(open.back() == '{') {
+					if(c == ',')
+						state = Key;
+					else if(c == '}')
+						close('}');
+					else
+						fail("expected ',' or '}'");
+				} else {
+					if(c == ',')
+						state = Value;
+					else if(c == ']')
+						close(']');
+					else
+						fail("expected ',' or ']'");
+				}
+				break;
+		}
+	}
+}
+
+//Postcondition: The value has been completely reported; throws
+//			ParseError if the input ended before it did.
+void json::PushParser::finish() {
+	if(state == Failed)
+		throw ParseError("parser has already failed");
+	if(state == Word) {		// Only the end of the input ends a top-level number.
+		emitWord(take(nullptr));
+		next();
+	}
+	if(state == Done)
+		return;
+	if(state == String)
+		fail("unterminated string");
+	if(!open.empty())
+		fail(open.back() == '{' ? "unterminated object" : "unterminated array");
+	fail("unexpected end of input");
+}
+
+void json::PushParser::fail(const char* what) {
+	state = Failed;
+	throw ParseError(what);
+}
+
+// Starts the value whose first character c is at the given position.
+// Postcondition: Returns where reading should carry on.
+const char* json::PushParser::begin(char c, const char* at) {
+	switch(c) {
+		case '\"':
+			key = state == ObjectFirst || state == Key;
+			state = String;
+			start = at + 1;
+			return at + 1;
+		case '{':
+			if(open.size() >= limit)
+				fail("nested too deeply");
+			handler.onObjectBegin();
+			open.push_back('{');
+			state = ObjectFirst;
+			return at + 1;
+		case '[':
+			if(open.size() >= limit)
+				fail("nested too deeply");
+			handler.onArrayBegin();
+			open.push_back('[');
+			state = ArrayFirst;
+			return at + 1;
+		case '}': case ']': case ':': case ',':
+			fail("unexpected character");
+	}
+	state = Word;
+	start = at;
+	return at;	// The word reads its first character itself.
+}
+
+// Reads the body of a string up to its closing quote or the end of the piece.
+// Postcondition: Returns where reading should carry on.
+const char* json::PushParser::string(const char* p, const char* end) {
+	for(; p != end; ++p) {
+		if(escaped) {
+			escaped = false;
+		} else if(*p == '\\') {
+			escaped = true;
+		} else if(*p == '\"') {
+			Slice s = take(p);
+			if(key)
+				handler.onKey(s);
+			else
+				handler.onString(s);
+			pending.clear();
+			if(key)
+				state = Colon;
+			else
+				next();
+			return p + 1;
+		}
+	}
+	pending.append(start, std::size_t(end - start));
+	return end;
+}
+
+const char* json::PushParser::word(const char* p, const char* end) {
+	for(; p != end; ++p) {
+		if(delimiter(*p)) {
+			emitWord(take(p));
+			next();
+			return p;	// The delimiter is read as part of what comes next.
+		}
+	}
+	pending.append(start, std::size_t(end - start));
+	return end;
+}
+
+// Returns the string or word that ends at the given position, which
+// is only in one place if none of it came in an earlier piece.
+json::Slice json::PushParser::take(const char* to) {
+	Slice s;
+	if(pending.empty()) {
+		s.data = start;
+		s.size = std::size_t(to - start);
+	} else {
+		if(to)
+			pending.append(start, std::size_t(to - start));
+		s.data = pending.data();
+		s.size = pending.size();
+	}
+	return s;
+}
+
+// Reports a bare word, checked the same way the Reader checks it.
+void json::PushParser::emitWord(Slice w) {
+	switch(*w.data) {
+		case 't':
+			if(w.size != 4 || std::memcmp(w.data, "true", 4) != 0)
+				fail("expected 'true'");
+			handler.onTrue();
+			break;
+		case 'f':
+			if(w.size != 5 || std::memcmp(w.data, "false", 5) != 0)
+				fail("expected 'false'");
+			handler.onFalse();
+			break;
+		case 'n':
+			if(w.size != 4 || std::memcmp(w.data, "null", 4) != 0)
+				fail("expected 'null'");
+			handler.onNull();
+			break;
+		default:
+			if(!isNumber(w))
+				fail("expected a value");
+			handler.onNumber(w);
+			break;
+	}
+	pending.clear();
+}
+
+void json::PushParser::close(char c) {
+	if(c == '}')
+		handler.onObjectEnd();
+	else
+		handler.onArrayEnd();
+	open.pop_back();
+	next();
+}
+
+// Moves on once a value has ended.
+void json::PushParser::next() {
+	state = open.empty() ? Done : After;
+}
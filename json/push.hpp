@@ -0,0 +1,76 @@
+// Douglas Keller
+
+#ifndef PUSH_HPP
+#define PUSH_HPP
+
+#include "json.hpp"
+#include <string>
+#include <vector>
+
+namespace json {
+
+	/*	The PushParser reads a json value from input that arrives a
+		piece at a time, like data from a socket. Each piece is parsed
+		as soon as it is fed in, and everything the parser needs to carry
+		on from where the piece ended is kept in its state, so the input
+		never has to be collected in one buffer first.
+
+		Parts of the value are reported to the handler as they are
+		read. Strings and numbers that are split between pieces are
+		put back together before they are reported; all others point
+		straight into the piece they were read from.
+
+		Once the value is complete, anything fed in after it is ignored,
+		as it is by json::parse with a Handler. feed and finish throw ParseError
+		if the input is not a json value, after which the parser is done
+		for, and every later call throws too.
+	*/
+	class PushParser {
+	public:
+		PushParser(Handler&);
+
+		PushParser(PushParser const&) = delete;
+		PushParser& operator= (PushParser const&) = delete;
+
+		void feed(const char* data, std::size_t size);
+		// Reports the end of the input, which is the only way a bare
+		// top-level number knows it has ended.
+		void finish();
+		// Whether a complete value has been read.
+		bool done() const { return state == Done; }
+
+	private:
+		enum State {
+			Value,			// A value must come next.
+			ArrayFirst,		// A value or ] must come next.
+			ObjectFirst,	// A key or } must come next.
+			Key,			// A key must come next.
+			Colon,			// A : must come next.
+			After,			// A , or the end of the open object or array must come next.
+			String,			// In the middle of a string.
+			Word,			// In the middle of a number, true, false or null.
+			Done,
+			Failed
+		};
+
+		Handler& handler;
+		State state;
+		std::vector<char> open;		// { or [ for each object or array not yet ended.
+		std::string pending;		// The start of a string or word split between pieces.
+		const char* start;			// Where the current string or word starts in this piece.
+		bool key;					// The string being read is a key.
+		bool escaped;				// The next character of the string is escaped.
+		std::size_t limit;			// maxDepth when the parser was made.
+
+		void fail(const char*);
+		const char* begin(char, const char*);
+		const char* string(const char*, const char*);
+		const char* word(const char*, const char*);
+		Slice take(const char*);
+		void emitWord(Slice);
+		void close(char);
+		void next();
+	};
+};
+
+#endif
@@ -0,0 +1,464 @@
+// Douglas Keller
+
+#include "query.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	using json::Tag;
+	using json::Slice;
+
+	std::uint64_t bit(std::size_t i) {
+		return std::uint64_t(1) << i;
+	}
+
+	// The tape tag for each Type, in the order of Type.
+	const Tag tags[] = { Tag::String, Tag::Object, Tag::Array, Tag::True, Tag::False, Tag::Null, Tag::Number };
+
+	// Decodes a number for comparing. Numbers too big for a double
+	// compare as infinity, which is still bigger or smaller than any
+	// number that fits.
+	bool decode(json::Number const& n, double& d) {
+		try {
+			d = n.asDouble();
+		} catch (std::range_error&) {
+			d = n.value.size && *n.value.data == '-' ? -HUGE_VAL : HUGE_VAL;
+		} catch (std::invalid_argument&) {
+			return false;
+		}
+		return true;
+	}
+
+	// How a Query gets around a tree of Values.
+	struct Tree {
+		typedef json::Value const* Node;
+
+		static bool valid(Node n) { return n != nullptr; }
+		static Tag type(Node n) { return tags[std::size_t(n->type)]; }
+		static Node find(Node n, Tag t, std::string const& key) {
+			return t == Tag::Object ? static_cast<json::Object const*>(n)->find(key) : nullptr;
+		}
+		static Node at(Node n, Tag t, std::size_t i) {
+			if(t != Tag::Array)
+				return nullptr;
+			json::Array const* a = static_cast<json::Array const*>(n);
+			return i < a->size ? a->values[i] : nullptr;
+		}
+		// Calls f with the key (or nullptr), position and value of every member or element.
+		template<class F> static void each(Node n, Tag t, F const& f) {
+			if(t == Tag::Object) {
+				json::Object const* o = static_cast<json::Object const*>(n);
+				for(std::size_t i = 0; i < o->size; ++i)
+					f(&o->members[i].key->text, i, o->members[i].value);
+			} else {
+				json::Array const* a = static_cast<json::Array const*>(n);
+				for(std::size_t i = 0; i < a->size; ++i)
+					f(static_cast<Slice const*>(nullptr), i, a->values[i]);
+			}
+		}
+		static Slice text(Node n, Tag t) {
+			return t == Tag::String ? static_cast<json::String const*>(n)->value
+					: static_cast<json::Number const*>(n)->value;
+		}
+		static bool number(Node n, double& d) {
+			return decode(*static_cast<json::Number const*>(n), d);
+		}
+	};
+
+	// How a Query gets around a Tape.
+	struct Flat {
+		typedef json::Cursor Node;
+
+		static bool valid(Node n) { return n.valid(); }
+		static Tag type(Node n) { return n.type(); }
+		static Node find(Node n, Tag, std::string const& key) { return n.find(key); }
+		static Node at(Node n, Tag, std::size_t i) { return n[i]; }
+		template<class F> static void each(Node n, Tag t, F const& f) {
+			std::size_t i = 0;
+			for(json::Iterator it = n.begin(); it != n.end(); ++it, ++i) {
+				if(t == Tag::Object) {
+					Slice key = it.key();
+					f(&key, i, *it);
+				} else {
+					f(static_cast<Slice const*>(nullptr), i, *it);
+				}
+			}
+		}
+		static Slice text(Node n, Tag) { return n.text(); }
+		static bool number(Node n, double& d) {
+			json::Number tmp;	// Tapes keep only the text, so decode it here.
+			tmp.value = n.text();
+			return decode(tmp, d);
+		}
+	};
+}
+
+//*****************************
+// Parser member functions
+//*****************************
+
+/*	The Parser reads a path one character at a time. Every
+	mistake is reported with the position it was found at.
+*/
+struct json::Query::Parser {
+	std::string const& text;
+	std::size_t pos;
+
+	Parser(std::string const& t) : text(t), pos(0) { }
+
+	void fail(const char* what) {
+		throw std::invalid_argument("Bad query at position " + std::to_string(pos) + ": " + what);
+	}
+	bool more() const { return pos < text.size(); }
+	char peek() const { return more() ? text[pos] : '\0'; }
+	bool accept(const char* s) {
+		std::size_t n = std::strlen(s);
+		if(text.compare(pos, n, s) != 0)
+			return false;
+		pos += n;
+		return true;
+	}
+	void expect(const char* s) {
+		if(!accept(s))
+			fail((std::string("expected '") + s + "'").c_str());
+	}
+	void space() {
+		while(peek() == ' ' || peek() == '\t')
+			++pos;
+	}
+
+	void path(std::vector<Step>&);
+	void selector(std::vector<Step>&);
+	void filter(Step&);
+	Test test();
+	void relative(std::vector<Test::Part>&);
+	void literal(Test&);
+	std::string name();
+	std::string quoted();
+	std::size_t number();
+};
+
+// A bare member name runs until a character that means something in a path.
+std::string json::Query::Parser::name() {
+	std::size_t start = pos;
+	while(more() && !std::strchr(".[]()=!<>&| \t\'\"", text[pos]))
+		++pos;
+	if(pos == start)
+		fail("expected a name");
+	return text.substr(start, pos - start);
+}
+
+// A name in quotes, which can hold any character but its own quote.
+std::string json::Query::Parser::quoted() {
+	char quote = text[pos++];
+	std::size_t end = text.find(quote, pos);
+	if(end == std::string::npos)
+		fail("unterminated string");
+	std::string s = text.substr(pos, end - pos);
+	pos = end + 1;
+	return s;
+}
+
+std::size_t json::Query::Parser::number() {
+	if(!std::isdigit(static_cast<unsigned char>(peek())))
+		fail("expected a number");
+	std::size_t n = 0;
+	while(std::isdigit(static_cast<unsigned char>(peek())))
+		n = n * 10 + std::size_t(text[pos++] - '0');
+	return n;
+}
+
+void json::Query::Parser::path(std::vector<Step>& steps) {
+	expect("$");
+	while(more()) {
+		Step s;
+		s.index = 0;
+		if(accept("..")) {
+			s.kind = Step::Descend;
+			steps.push_back(s);
+			if(peek() == '[') {
+				++pos;
+				selector(steps);
+				continue;
+			}
+			if(accept("*")) {
+				s.kind = Step::Any;
+			} else {
+				s.kind = Step::Key;
+				s.key = name();
+			}
+		} else if(accept(".")) {
+			if(accept("*")) {
+				s.kind = Step::Any;
+			} else {
+				s.kind = Step::Key;
+				s.key = name();
+			}
+		} else if(accept("[")) {
+			selector(steps);
+			continue;
+		} else {
+			fail("expected '.' or '['");
+		}
+		steps.push_back(s);
+	}
+	if(steps.size() > maxSteps)
+		fail("too many steps");
+}
+
+// Reads what is between [ and ], once the [ has been read.
+void json::Query::Parser::selector(std::vector<Step>& steps) {
+	Step s;
+	s.index = 0;
+	space();
+	if(accept("*")) {
+		s.kind = Step::Any;
+	} else if(peek() == '\'' || peek() == '\"') {
+		s.kind = Step::Key;
+		s.key = quoted();
+	} else if(accept("?")) {
+		s.kind = Step::Filter;
+		space();
+		bool parens = accept("(");
+		filter(s);
+		if(parens)
+			expect(")");
+	} else {
+		s.kind = Step::Index;
+		s.index = number();
+	}
+	space();
+	expect("]");
+	steps.push_back(s);
+}
+
+// Tests joined by && bind more tightly than alternatives joined by ||.
+void json::Query::Parser::filter(Step& s) {
+	do {
+		std::vector<Test> all;
+		do {
+			all.push_back(test());
+			space();
+		} while(accept("&&"));
+		s.tests.push_back(all);
+	} while(accept("||"));
+}
+
+json::Query::Test json::Query::Parser::test() {
+	Test t;
+	t.op = Test::Exists;
+	t.type = Tag::Null;
+	t.number = 0;
+	space();
+	relative(t.path);
+	space();
+	if(accept("=="))      t.op = Test::Equal;
+	else if(accept("!=")) t.op = Test::NotEqual;
+	else if(accept("<=")) t.op = Test::LessEqual;
+	else if(accept(">=")) t.op = Test::GreaterEqual;
+	else if(accept("<"))  t.op = Test::Less;
+	else if(accept(">"))  t.op = Test::Greater;
+	else if(accept("="))  t.op = Test::Equal;
+	if(t.op != Test::Exists) {
+		space();
+		literal(t);
+	}
+	return t;
+}
+
+// A path below the value being tested, which starts with @
+// or, for short, with the name of one of its members.
+void json::Query::Parser::relative(std::vector<Test::Part>& parts) {
+	Test::Part p;
+	p.element = false;
+	p.index = 0;
+	if(!accept("@")) {
+		p.key = name();
+		parts.push_back(p);
+	}
+	for(;;) {
+		p.element = false;
+		if(accept(".")) {
+			p.key = name();
+		} else if(accept("[")) {
+			space();
+			if(peek() == '\'' || peek() == '\"') {
+				p.key = quoted();
+			} else {
+				p.element = true;
+				p.index = number();
+			}
+			space();
+			expect("]");
+		} else {
+			return;
+		}
+		parts.push_back(p);
+	}
+}
+
+void json::Query::Parser::literal(Test& t) {
+	if(peek() == '\'' || peek() == '\"') {
+		t.type = Tag::String;
+		t.text = quoted();
+	} else if(accept("true")) {
+		t.type = Tag::True;
+	} else if(accept("false")) {
+		t.type = Tag::False;
+	} else if(accept("null")) {
+		t.type = Tag::Null;
+	} else {
+		const char* start = text.c_str() + pos;
+		char* end = nullptr;
+		t.type = Tag::Number;
+		t.number = std::strtod(start, &end);
+		if(end == start)
+			fail("expected a literal");
+		pos += std::size_t(end - start);
+	}
+}
+
+//*****************************
+// Query member functions
+//*****************************
+
+const std::size_t json::Query::maxSteps;
+
+json::Query::Query(std::string const& path) : broad(0), descend(0) {
+	Parser p(path);
+	p.path(steps);
+	for(std::size_t i = 0; i < steps.size(); ++i) {
+		if(steps[i].kind != Step::Key && steps[i].kind != Step::Index)
+			broad |= bit(i);
+		if(steps[i].kind == Step::Descend)
+			descend |= bit(i);
+	}
+}
+
+std::vector<json::Value const*> json::Query::select(Value const* root) const {
+	std::vector<Value const*> found;
+	if(root)
+		run<Tree>(root, 1, found);
+	return found;
+}
+
+std::vector<json::Cursor> json::Query::select(Cursor root) const {
+	std::vector<Cursor> found;
+	if(root.valid())
+		run<Flat>(root, 1, found);
+	return found;
+}
+
+// Recursive method that runs the automaton on the value n,
+// which is in the given set of states.
+template<class A>
+void json::Query::run(typename A::Node n, std::uint64_t states, std::vector<typename A::Node>& found) const {
+	// A .. step matches the value itself as well as everything below it.
+	if(states & descend)
+		for(std::size_t i = 0; i < steps.size(); ++i)
+			if(states & descend & bit(i))
+				states |= bit(i + 1);
+
+	if(states & bit(steps.size()))
+		found.push_back(n);
+	std::uint64_t live = states & (bit(steps.size()) - 1);	// States with a step left.
+	if(!live)
+		return;		// Nothing below n can match.
+
+	Tag t = A::type(n);
+	if(t != Tag::Object && t != Tag::Array)
+		return;
+
+	if(!(live & broad) && !(live & (live - 1))) {
+		// One member or element is wanted, so go straight to it.
+		std::size_t i = std::size_t(__builtin_ctzll(live));
+		Step const& s = steps[i];
+		typename A::Node c = s.kind == Step::Key ? A::find(n, t, s.key) : A::at(n, t, s.index);
+		if(A::valid(c))
+			run<A>(c, bit(i + 1), found);
+		return;
+	}
+
+	A::each(n, t, [&](Slice const* key, std::size_t index, typename A::Node c) {
+		std::uint64_t next = 0;
+		for(std::uint64_t rest = live; rest; rest &= rest - 1) {
+			std::size_t i = std::size_t(__builtin_ctzll(rest));
+			Step const& s = steps[i];
+			switch(s.kind) {
+				case Step::Key:
+					if(key && *key == s.key)
+						next |= bit(i + 1);
+					break;
+				case Step::Index:
+					if(!key && index == s.index)
+						next |= bit(i + 1);
+					break;
+				case Step::Any:
+					next |= bit(i + 1);
+					break;
+				case Step::Descend:
+					next |= bit(i);
+					break;
+				case Step::Filter:
+					if(this->passes<A>(c, s))
+						next |= bit(i + 1);
+					break;
+			}
+		}
+		if(next)
+			this->run<A>(c, next, found);
+	});
+}
+
+template<class A>
+bool json::Query::passes(typename A::Node n, Step const& s) const {
+	for(std::vector<Test> const& all : s.tests) {
+		bool pass = true;
+		for(std::size_t i = 0; pass && i < all.size(); ++i)
+			pass = passes<A>(n, all[i]);
+		if(pass)
+			return true;
+	}
+	return false;
+}
+
+// Values of different types are never equal, and never ordered;
+// neither is a value that is missing.
+template<class A>
+bool json::Query::passes(typename A::Node n, Test const& test) const {
+	for(Test::Part const& p : test.path) {
+		Tag t = A::type(n);
+		n = p.element ? A::at(n, t, p.index) : A::find(n, t, p.key);
+		if(!A::valid(n))
+			return test.op == Test::NotEqual;
+	}
+	if(test.op == Test::Exists)
+		return true;
+
+	Tag t = A::type(n);
+	if(t != test.type)
+		return test.op == Test::NotEqual;
+	int c = 0;	// Less than, equal to or greater than the literal.
+	if(t == Tag::Number) {
+		double d;
+		if(!A::number(n, d))
+			return test.op == Test::NotEqual;
+		c = d < test.number ? -1 : d > test.number ? 1 : 0;
+	} else if(t == Tag::String) {
+		Slice s = A::text(n, t);
+		c = -test.text.compare(0, std::string::npos, s.data, s.size);
+	}	// true, false and null only equal themselves.
+
+	switch(test.op) {
+		case Test::Equal:        return c == 0;
+		case Test::NotEqual:     return c != 0;
+		case Test::Less:         return c < 0;
+		case Test::LessEqual:    return c <= 0;
+		case Test::Greater:      return c > 0;
+		case Test::GreaterEqual: return c >= 0;
+		default:                 return true;
+	}
+}
@@ -0,0 +1,89 @@
+// Douglas Keller
+
+#ifndef QUERY_HPP
+#define QUERY_HPP
+
+#include "json.hpp"
+#include "tape.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace json {
+
+	/*	A Query is a JSONPath expression compiled once, so it can be
+		run against any number of documents. It understands
+			$                  the document's top value
+			.name  ['name']    a member of an object
+			[2]                an element of an array
+			.*  [*]            every member or element
+			..name  ..*        the same, at any depth below
+			[?test]            every member or element that passes test
+		where a test compares a path below the value being tested with
+		a literal, as in $.orders[*].items[?price>10].sku, or just
+		checks that the path exists, as in [?@.sku]. Tests can be
+		joined with && and ||. Strings are compared as they were
+		written, escape sequences and all.
+
+		The path is compiled into a small automaton with one state
+		per step. Running it walks only the parts of a document some
+		state can still match: a step like .name looks its member up
+		directly instead of visiting the rest of the object, and
+		nothing below a value is visited once no step is left for it.
+	*/
+	class Query {
+	public:
+		// Throws std::invalid_argument if the path is not one a Query understands.
+		explicit Query(std::string const& path);
+
+		// Return every value the path matches, in document order. They
+		// point into the document, which must outlive them.
+		std::vector<Value const*> select(Value const* root) const;
+		std::vector<Cursor> select(Cursor root) const;
+
+		// The most steps a path can have.
+		static const std::size_t maxSteps = 63;
+
+	private:
+		// A comparison of the value at a path with a literal.
+		struct Test {
+			enum Op { Exists, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+			struct Part {
+				bool element;		// An array element rather than an object member.
+				std::string key;
+				std::size_t index;
+			};
+			std::vector<Part> path;	// Relative to the value being tested.
+			Op op;
+			Tag type;			// The literal's type: String, Number, True, False or Null.
+			std::string text;	// A string literal.
+			double number;		// A number literal.
+		};
+
+		struct Step {
+			enum Kind { Key, Index, Any, Descend, Filter };
+			Kind kind;
+			std::string key;
+			std::size_t index;
+			// For Filter: the tests, as a list of alternatives that
+			// each pass only if all of their tests pass.
+			std::vector<std::vector<Test> > tests;
+		};
+
+		// Compiles a path into steps.
+		struct Parser;
+
+		// Bit i of a set of states stands for "step i is next".
+		std::vector<Step> steps;
+		std::uint64_t broad;	// The states that have to look at every child.
+		std::uint64_t descend;	// The states for .. steps.
+
+		// A is Tree or Flat in query.cpp, which say how to get around
+		// a tree of Values or a Tape.
+		template<class A> void run(typename A::Node, std::uint64_t, std::vector<typename A::Node>&) const;
+		template<class A> bool passes(typename A::Node, Step const&) const;
+		template<class A> bool passes(typename A::Node, Test const&) const;
+	};
+};
+
+#endif
@@ -0,0 +1,288 @@
+// Douglas Keller
+
+#ifndef READER_HPP
+#define READER_HPP
+
+#include "json.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include <cstring>
+#include <vector>
+
+namespace json {
+
+	// Whether w is written the way json writes a number:
+	// an optional minus, an integer part with no leading zeros,
+	// and an optional fraction and exponent.
+	inline bool isNumber(Slice w) {
+		const char* p = w.data;
+		const char* end = w.data + w.size;
+		auto digits = [&p, end] {
+			const char* first = p;
+			while(p != end && *p >= '0' && *p <= '9')
+				++p;
+			return p != first;
+		};
+		if(p != end && *p == '-')
+			++p;
+		if(p != end && *p == '0')
+			++p;
+		else if(!digits())
+			return false;
+		if(p != end && *p == '.') {
+			++p;
+			if(!digits())
+				return false;
+		}
+		if(p != end && (*p == 'e' || *p == 'E')) {
+			++p;
+			if(p != end && (*p == '+' || *p == '-'))
+				++p;
+			if(!digits())
+				return false;
+		}
+		return p == end;
+	}
+
+	/*	The Reader is the second stage of the parser. It walks the
+		tokens found by the Scanner and reports each part of a json
+		value to its handler as it is read, so nothing is kept once
+		the handler has seen it.
+
+		The Reader is a template so that handlers known at compile
+		time, like the one that builds a Document, are called
+		directly rather than through the Handler vtable.
+	*/
+	template<class H>
+	class Reader {
+	public:
+		Reader(const char* d, std::size_t size, H& h)
+			: scan(d, size), data(d), handler(h), limit(maxDepth()), outer(0) { }
+
+		// Reads one complete value and reports it to the handler.
+		void read() { value(scan.next()); }
+		// Throws ParseError unless only whitespace follows the value read.
+		void finish() {
+			if(scan.next() != scan.size())
+				throw ParseError("unexpected input after the value");
+		}
+		// Reads values separated by commas up to the end of the input,
+		// like the inside of an array without its brackets, and reports
+		// each of them to the handler.
+		void elements();
+
+	private:
+		Scanner scan;
+		const char* data;
+		H& handler;
+		std::vector<char> open;		// { or [ for each object or array not yet ended.
+		std::size_t limit;			// maxDepth when the Reader was made.
+		std::size_t outer;			// Arrays around the input that are not part of it.
+
+		void value(std::size_t);
+		void enter(char);
+		void key(std::size_t);
+		Slice string(std::size_t);
+		Slice word(std::size_t);
+		std::size_t expect(char, const char*);
+	};
+
+	/*	Reports the value starting at the token pos. Objects and arrays
+		are read on an explicit stack, open, rather than by recursion,
+		so nesting only costs a byte of it per level, and the stack of
+		the calling thread is safe no matter what the input is.
+	*/
+	template<class H>
+	void Reader<H>::value(std::size_t pos) {
+		for(;;) {
+			if(pos == scan.size())
+				throw ParseError("unexpected end of input");
+
+			// Choose Value type based off the token's first character.
+			switch(data[pos]) {
+				case '\"':
+					handler.onString(string(pos));
+					break;
+				case '{':
+					enter('{');
+					handler.onObjectBegin();
+					pos = scan.next();
+					if(pos != scan.size() && data[pos] == '}') {	// An empty object.
+						open.pop_back();
+						handler.onObjectEnd();
+						break;
+					}
+					key(pos);
+					pos = scan.next();
+					continue;	// Read the first member's value.
+				case '[':
+					enter('[');
+					handler.onArrayBegin();
+					pos = scan.next();
+					if(pos != scan.size() && data[pos] == ']') {	// An empty array.
+						open.pop_back();
+						handler.onArrayEnd();
+						break;
+					}
+					continue;	// Read the first element.
+				case '}': case ']': case ':': case ',':
+					throw ParseError("unexpected character");
+				default: {
+					Slice w = word(pos);
+					switch(*w.data) {
+						case 't':
+							if(w.size != 4 || std::memcmp(w.data, "true", 4) != 0)
+								throw ParseError("expected 'true'");
+							handler.onTrue();
+							break;
+						case 'f':
+							if(w.size != 5 || std::memcmp(w.data, "false", 5) != 0)
+								throw ParseError("expected 'false'");
+							handler.onFalse();
+							break;
+						case 'n':
+							if(w.size != 4 || std::memcmp(w.data, "null", 4) != 0)
+								throw ParseError("expected 'null'");
+							handler.onNull();
+							break;
+						default:
+							// If the word doesn't match any other value type, it must be a number.
+							if(!isNumber(w))
+								throw ParseError("expected a value");
+							handler.onNumber(w);
+							break;
+					}
+					break;
+				}
+			}
+
+			// A value has been read. A comma means another member or element
+			// of the innermost open object or array follows; anything else
+			// must end it, which ends a value of the one around it.
+			for(;;) {
+				if(open.empty())
+					return;
+				std::size_t next = scan.next();
+				if(open.back() == '{') {
+					if(next == scan.size())
+						throw ParseError("unterminated object");
+					if(data[next] == '}') {
+						open.pop_back();
+						handler.onObjectEnd();
+						continue;
+					}
+					if(data[next] != ',')
+						throw ParseError("expected ',' or '}'");
+					key(scan.next());
+				} else {
+					if(next == scan.size())
+						throw ParseError("unterminated array");
+					if(data[next] == ']') {
+						open.pop_back();
+						handler.onArrayEnd();
+						continue;
+					}
+					if(data[next] != ',')
+						throw ParseError("expected ',' or ']'");
+				}
+				pos = scan.next();
+				break;
+			}
+		}
+	}
+
+	template<class H>
+	void Reader<H>::elements() {
+		outer = 1;
+		for(;;) {
+			value(scan.next());
+
+			std::size_t next = scan.next();
+			if(next == scan.size())
+				return;
+			if(data[next] != ',')
+				throw ParseError("expected ',' or ']'");
+		}
+	}
+
+	// Opens an object or array, if that does not nest it too deeply.
+	template<class H>
+	void Reader<H>::enter(char c) {
+		if(outer + open.size() >= limit)
+			throw ParseError("nested too deeply");
+		open.push_back(c);
+	}
+
+	// Reports the key at pos and consumes the colon after it.
+	template<class H>
+	void Reader<H>::key(std::size_t pos) {
+		if(pos == scan.size() || data[pos] != '\"')
+			throw ParseError("expected a key");
+		handler.onKey(string(pos));
+		expect(':', "expected ':'");
+	}
+
+	//Precondition:  pos is the position of a string's opening quote.
+	//Postcondition: Returns the string's characters, with escape sequences
+	//			left as they were written.
+	template<class H>
+	Slice Reader<H>::string(std::size_t pos) {
+		// The scanner has already found the closing quote; it is the next token.
+		std::size_t close = scan.next();
+		if(close == scan.size())
+			throw ParseError("unterminated string");
+		Slice s;
+		s.data = data + pos + 1;
+		s.size = close - pos - 1;
+		return s;
+	}
+
+	// A bare word runs until whitespace, an end brace, a comma,
+	// a colon, or the end of the input.
+	template<class H>
+	Slice Reader<H>::word(std::size_t pos) {
+		const char* end = data + pos;
+		const char* last = data + scan.size();
+		while(end != last) {
+			char c = *end;
+			if(c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' || c == '}' || c == ']' || c == ':')
+				break;
+			++end;
+		}
+		Slice s;
+		s.data = data + pos;
+		s.size = std::size_t(end - s.data);
+		return s;
+	}
+
+	// Consumes the next token, which must be the character c.
+	template<class H>
+	std::size_t Reader<H>::expect(char c, const char* error) {
+		std::size_t pos = scan.next();
+		if(pos == scan.size() || data[pos] != c)
+			throw ParseError(error);
+		return pos;
+	}
+
+	/*	Reads one complete value, with nothing but whitespace after it,
+		and reports it to h. While stats are being collected, its values
+		are counted as they are read and added to them with its size.
+	*/
+	template<class H>
+	void readWhole(const char* data, std::size_t size, H& h) {
+		StatsCollector* s = StatsCollector::enabled ? StatsCollector::current() : nullptr;
+		if(!s) {
+			Reader<H> r(data, size, h);
+			r.read();
+			r.finish();
+			return;
+		}
+		Counted<H> c(h);
+		Reader<Counted<H> > r(data, size, c);
+		r.read();
+		r.finish();
+		c.census.report(*s, size);
+	}
+};
+
+#endif
@@ -0,0 +1,196 @@
+// Douglas Keller
+
+#include "scanner.hpp"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define JSON_X86 1
+#endif
+
+namespace {
+
+	using json::Masks;
+	using json::Classifier;
+
+	// The portable version, used when no vector unit is available.
+	void classifyScalar(const char* block, Masks& m) {
+		m.quote = m.backslash = m.op = m.space = 0;
+		for(int i = 0; i < 64; ++i) {
+			uint64_t bit = uint64_t(1) << i;
+			switch(block[i]) {
+				case '\"': m.quote |= bit; break;
+				case '\\': m.backslash |= bit; break;
+				case '{': case '}': case '[': case ']': case ':': case ',':
+					m.op |= bit; break;
+				case ' ': case '\t': case '\n': case '\r':
+					m.space |= bit; break;
+			}
+		}
+	}
+
+#ifdef JSON_X86
+	// SSE2 is part of every x86-64 processor, so it needs no check.
+	void classifySSE2(const char* block, Masks& m) {
+		m.quote = m.backslash = m.op = m.space = 0;
+		for(int i = 0; i < 4; ++i) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+			#define EQ(c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+			__m128i op = _mm_or_si128(_mm_or_si128(_mm_or_si128(EQ('{'), EQ('}')), _mm_or_si128(EQ('['), EQ(']'))),
+					_mm_or_si128(EQ(':'), EQ(',')));
+			__m128i space = _mm_or_si128(_mm_or_si128(EQ(' '), EQ('\t')), _mm_or_si128(EQ('\n'), EQ('\r')));
+			int shift = 16 * i;
+			m.quote     |= uint64_t(uint16_t(_mm_movemask_epi8(EQ('\"')))) << shift;
+			m.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(EQ('\\')))) << shift;
+			#undef EQ
+			m.op        |= uint64_t(uint16_t(_mm_movemask_epi8(op))) << shift;
+			m.space     |= uint64_t(uint16_t(_mm_movemask_epi8(space))) << shift;
+		}
+	}
+
+	// AVX2 classifies 32 characters per instruction; it is only
+	// used when the processor reports that it supports it.
+	__attribute__((target("avx2")))
+	void classifyAVX2(const char* block, Masks& m) {
+		m.quote = m.backslash = m.op = m.space = 0;
+		for(int i = 0; i < 2; ++i) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+			#define EQ(c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+			__m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(EQ('{'), EQ('}')), _mm256_or_si256(EQ('['), EQ(']'))),
+					_mm256_or_si256(EQ(':'), EQ(',')));
+			__m256i space = _mm256_or_si256(_mm256_or_si256(EQ(' '), EQ('\t')), _mm256_or_si256(EQ('\n'), EQ('\r')));
+			int shift = 32 * i;
+			m.quote     |= uint64_t(uint32_t(_mm256_movemask_epi8(EQ('\"')))) << shift;
+			m.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(EQ('\\')))) << shift;
+			#undef EQ
+			m.op        |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << shift;
+			m.space     |= uint64_t(uint32_t(_mm256_movemask_epi8(space))) << shift;
+		}
+	}
+#endif
+
+	// Picks the widest classifier this processor supports.
+	struct Dispatch {
+		Classifier classify;
+		const char* name;
+
+		Dispatch() : classify(classifyScalar), name("scalar") {
+#ifdef JSON_X86
+			classify = classifySSE2;
+			name = "sse2";
+			__builtin_cpu_init();
+			if(__builtin_cpu_supports("avx2")) {
+				classify = classifyAVX2;
+				name = "avx2";
+			}
+#endif
+		}
+	};
+
+	Dispatch const& dispatch() {
+		static Dispatch d;
+		return d;
+	}
+
+	// Number of blocks indexed by each call to refill.
+	const uint32_t batchBlocks = 1024;
+}
+
+//*****************************
+// Scanner member functions
+//*****************************
+
+json::Scanner::Scanner(const char* data, std::size_t size)
+	: input(data), length(size), scanned(0),
+	  inString(false), escaped(false), inWord(false),
+	  classify(dispatch().classify), batch(0), count(0), cursor(0) {
+	// There is at most one token per character, so the index never needs
+	// more room than one batch, or the whole input if that is shorter.
+	index.resize(std::min<std::size_t>(batchBlocks * 64, (size + 63) / 64 * 64));
+}
+
+//Postcondition: The index holds the tokens of the next batch of blocks
+//			that contains any. Returns false once the input is used up.
+bool json::Scanner::refill() {
+	count = 0;
+	cursor = 0;
+	while(count == 0 && scanned < length) {
+		batch = scanned;
+		for(uint32_t offset = 0; offset < batchBlocks * 64 && scanned < length; offset += 64) {
+			if(length - scanned >= 64) {
+				scanBlock(input + scanned, offset);
+			} else {
+				// Pad the final partial block with spaces, which are never tokens.
+				char last[64];
+				std::memset(last, ' ', sizeof(last));
+				std::memcpy(last, input + scanned, length - scanned);
+				scanBlock(last, offset);
+			}
+			scanned += 64;
+		}
+	}
+	if(scanned > length)
+		scanned = length;
+	return count != 0;
+}
+
+// Finds the tokens in one 64 character block and appends their
+// positions, offset by the block's place in the batch, to the index.
+void json::Scanner::scanBlock(const char* block, uint32_t offset) {
+	Masks m;
+	classify(block, m);
+
+	// Work out which characters are escaped. Backslashes are rare, so
+	// each one that is not itself escaped is handled one at a time.
+	uint64_t esc = 0;
+	uint64_t bs = m.backslash;
+	if(escaped) {
+		esc |= 1;
+		bs &= ~uint64_t(1);
+	}
+	escaped = false;
+	while(bs) {
+		int i = __builtin_ctzll(bs);
+		if(i == 63) {	// The escaped character starts the next block.
+			escaped = true;
+			break;
+		}
+		esc |= uint64_t(1) << (i + 1);
+		bs &= ~(uint64_t(3) << i);
+	}
+
+	// The bits from each opening quote up to its closing quote are
+	// found with a prefix xor over the unescaped quotes.
+	uint64_t quote = m.quote & ~esc;
+	uint64_t string = quote;
+	string ^= string << 1;
+	string ^= string << 2;
+	string ^= string << 4;
+	string ^= string << 8;
+	string ^= string << 16;
+	string ^= string << 32;
+	if(inString)
+		string = ~string;
+	inString = (string >> 63) != 0;
+
+	// Bare words are runs of anything else outside of a string;
+	// only the first character of each run is a token.
+	uint64_t word = ~(m.op | m.space | quote | string);
+	uint64_t wordStart = word & ~((word << 1) | (inWord ? 1 : 0));
+	inWord = (word >> 63) != 0;
+
+	// The padding past the end of the input is all spaces, so it never
+	// holds a token. The index always has room for a full batch.
+	uint64_t tokens = (m.op & ~string) | quote | wordStart;
+	uint32_t* out = &index[count];
+	count += std::size_t(__builtin_popcountll(tokens));
+	while(tokens) {
+		*out++ = offset + uint32_t(__builtin_ctzll(tokens));
+		tokens &= tokens - 1;
+	}
+}
+
+const char* json::scannerKind() {
+	return dispatch().name;
+}
@@ -0,0 +1,86 @@
+// Douglas Keller
+
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace json {
+
+	// Every character class the Scanner cares about, as one
+	// bit per character of a 64 character block.
+	struct Masks {
+		uint64_t quote;
+		uint64_t backslash;
+		uint64_t op;		// { } [ ] : ,
+		uint64_t space;		// ' ' \t \n \r
+	};
+
+	typedef void (*Classifier)(const char*, Masks&);
+
+	/*	The Scanner is the first stage of the parser. It classifies
+		its input 64 characters at a time with vector instructions
+		and records the position of every token the second stage
+		needs to look at:
+			- every unescaped double quote, opening or closing,
+			- every { } [ ] : and , outside of a string,
+			- the first character of every bare word (numbers,
+			  true, false and null).
+		Everything else, including the bodies of strings, is never
+		looked at again.
+
+		The index is built a batch of blocks at a time, so memory use
+		does not grow with the size of the input.
+	*/
+	class Scanner {
+	public:
+		Scanner(const char* data, std::size_t size);
+
+		// Returns the position of the next token and moves past it,
+		// or size() when there are no tokens left.
+		std::size_t next() {
+			if(cursor == count && !refill())
+				return length;
+			return batch + index[cursor++];
+		}
+		// Returns the position of the next token without moving past it.
+		std::size_t peek() {
+			if(cursor == count && !refill())
+				return length;
+			return batch + index[cursor];
+		}
+
+		const char* data() const { return input; }
+		std::size_t size() const { return length; }
+
+	private:
+		const char* input;
+		std::size_t length;
+		std::size_t scanned;	// Number of characters indexed so far.
+
+		// State carried from one block to the next.
+		bool inString;		// The previous block ended inside a string.
+		bool escaped;		// The next block's first character is escaped.
+		bool inWord;		// The previous block ended in the middle of a bare word.
+
+		Classifier classify;	// The fastest classifier this processor supports.
+
+		// Token positions are stored relative to the start of their
+		// batch, which keeps the index small.
+		std::vector<uint32_t> index;
+		std::size_t batch;		// Position of the current batch.
+		std::size_t count;		// Number of tokens in the current batch.
+		std::size_t cursor;
+
+		bool refill();
+		void scanBlock(const char*, uint32_t offset);
+	};
+
+	// The name of the vector instruction set the Scanner chose
+	// for this machine: "avx2", "sse2" or "scalar".
+	const char* scannerKind();
+};
+
+#endif
@@ -0,0 +1,86 @@
+// Douglas Keller
+
+#include "stats.hpp"
+#include "json.hpp"
+#include <cstdio>
+
+std::atomic<json::StatsCollector*> json::StatsCollector::active(nullptr);
+const bool json::StatsCollector::enabled;
+
+//*****************************
+// StatsCollector member functions
+//*****************************
+
+json::StatsCollector::StatsCollector() {
+	for(std::atomic<std::uint64_t>& c : counts)
+		c.store(0);
+	outer = active.exchange(this);
+}
+
+json::StatsCollector::~StatsCollector() {
+	active.store(outer);
+}
+
+json::Stats json::StatsCollector::stats() const {
+	Stats s;
+	s.bytes = counts[Bytes].load();
+	s.objects = counts[Objects].load();
+	s.arrays = counts[Arrays].load();
+	s.strings = counts[Strings].load();
+	s.numbers = counts[Numbers].load();
+	s.literals = counts[Literals].load();
+	s.maxDepth = counts[MaxDepth].load();
+	s.stringBytes = counts[StringBytes].load();
+	s.allocations = counts[Allocations].load();
+	s.parseSeconds = double(counts[ParseNanos].load()) / 1e9;
+	s.printSeconds = double(counts[PrintNanos].load()) / 1e9;
+	s.outputSeconds = double(counts[OutputNanos].load()) / 1e9;
+	s.filterSeconds = double(counts[FilterNanos].load()) / 1e9;
+	return s;
+}
+
+// Postcondition: The counter is at least n.
+void json::StatsCollector::raise(Counter c, std::uint64_t n) {
+	std::uint64_t now = counts[c].load(std::memory_order_relaxed);
+	while(now < n && !counts[c].compare_exchange_weak(now, n, std::memory_order_relaxed)) { }
+}
+
+void json::Stats::write(std::ostream& os) const {
+	char line[512];
+	std::snprintf(line, sizeof(line), "{\"bytes\": %llu, \"objects\": %llu, \"arrays\": %llu, "
+			"\"strings\": %llu, \"numbers\": %llu, \"literals\": %llu, \"max_depth\": %llu, "
+			"\"string_bytes\": %llu, \"allocations\": %llu, \"parse_seconds\": %.6f, "
+			"\"print_seconds\": %.6f, \"output_seconds\": %.6f, \"filter_seconds\": %.6f}",
+			(unsigned long long)bytes, (unsigned long long)objects, (unsigned long long)arrays,
+			(unsigned long long)strings, (unsigned long long)numbers, (unsigned long long)literals,
+			(unsigned long long)maxDepth, (unsigned long long)stringBytes, (unsigned long long)allocations,
+			parseSeconds, printSeconds, outputSeconds, filterSeconds);
+	os << line;
+}
+
+//*****************************
+// Census member functions
+//*****************************
+
+json::Census::Census() : depth(0) {
+	for(std::uint64_t& c : counts)
+		c = 0;
+}
+
+// Postcondition: inner's values are counted here, as if they had
+//			been read inside every object and array open here.
+void json::Census::add(Census const& inner) {
+	for(int c = StatsCollector::Objects; c <= StatsCollector::StringBytes; ++c)
+		if(c != StatsCollector::MaxDepth)
+			counts[c] += inner.counts[c];
+	if(depth + inner.counts[StatsCollector::MaxDepth] > counts[StatsCollector::MaxDepth])
+		counts[StatsCollector::MaxDepth] = depth + inner.counts[StatsCollector::MaxDepth];
+}
+
+void json::Census::report(StatsCollector& s, std::size_t bytes) const {
+	s.add(StatsCollector::Bytes, bytes);
+	for(int c = StatsCollector::Objects; c <= StatsCollector::StringBytes; ++c)
+		if(c != StatsCollector::MaxDepth)
+			s.add(StatsCollector::Counter(c), counts[c]);
+	s.raise(StatsCollector::MaxDepth, counts[StatsCollector::MaxDepth]);
+}
@@ -0,0 +1,164 @@
+// Douglas Keller
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "json.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace json {
+
+	// What the documents parsed, printed, exported and filtered while
+	// a StatsCollector was active have added up to. Values are counted
+	// as they are read, so every value in the input counts, including
+	// members a repeated key replaces and values a filter leaves out.
+	struct Stats {
+		std::uint64_t bytes;		// Characters of input parsed.
+		std::uint64_t objects;
+		std::uint64_t arrays;
+		std::uint64_t strings;
+		std::uint64_t numbers;
+		std::uint64_t literals;		// true, false and null.
+		std::uint64_t maxDepth;		// The deepest any parsed value was nested.
+		std::uint64_t stringBytes;	// Characters in every string and key, as written.
+		std::uint64_t allocations;	// Blocks the arenas took from the system.
+		double parseSeconds;
+		double printSeconds;
+		double outputSeconds;
+		double filterSeconds;
+
+		// Writes the stats as a single json object.
+		void write(std::ostream&) const;
+	};
+
+	/*	A StatsCollector gathers Stats from every document on every
+		thread for as long as it lives. Only one collects at a time;
+		a new one takes over until it is destroyed, and then the one
+		before it carries on.
+
+		Stats are only kept when the library is built with JSON_STATS
+		defined. Without it, every hook below is empty and compiles
+		away, and a collector's stats stay zero. With it, documents
+		pay one check per operation when nothing is collecting; values
+		are only counted when something is.
+	*/
+	class StatsCollector {
+	public:
+		StatsCollector();
+		~StatsCollector();
+
+		StatsCollector(StatsCollector const&) = delete;
+		StatsCollector& operator= (StatsCollector const&) = delete;
+
+		Stats stats() const;
+
+		// Whether the library was built to keep stats at all.
+#ifdef JSON_STATS
+		static const bool enabled = true;
+#else
+		static const bool enabled = false;
+#endif
+
+		enum Counter {
+			Bytes, Objects, Arrays, Strings, Numbers, Literals, MaxDepth, StringBytes,
+			Allocations, ParseNanos, PrintNanos, OutputNanos, FilterNanos, Counters
+		};
+		void add(Counter c, std::uint64_t n) { counts[c].fetch_add(n, std::memory_order_relaxed); }
+		void raise(Counter, std::uint64_t);
+
+		// The collector that is active, or nullptr.
+		static StatsCollector* current() { return active.load(std::memory_order_acquire); }
+
+	private:
+		std::atomic<std::uint64_t> counts[Counters];
+		StatsCollector* outer;
+
+		static std::atomic<StatsCollector*> active;
+	};
+
+	// Counts values as a parser reads them, for one parse.
+	struct Census {
+		std::uint64_t counts[StatsCollector::Counters];
+		std::uint64_t depth;
+
+		Census();
+		void enter() {
+			if(++depth > counts[StatsCollector::MaxDepth])
+				counts[StatsCollector::MaxDepth] = depth;
+		}
+		// Adds the counts of values read inside the ones open here.
+		void add(Census const&);
+		// Adds the counts and the number of characters read to s.
+		void report(StatsCollector& s, std::size_t bytes) const;
+	};
+
+	// Passes a parser's events on to a handler, counting each value.
+	template<class H> struct Counted {
+		H& handler;
+		Census census;
+		Counted(H& h) : handler(h) { }
+
+		void onObjectBegin() { ++census.counts[StatsCollector::Objects]; census.enter(); handler.onObjectBegin(); }
+		void onKey(Slice k)  { census.counts[StatsCollector::StringBytes] += k.size; handler.onKey(k); }
+		void onObjectEnd()   { --census.depth; handler.onObjectEnd(); }
+		void onArrayBegin()  { ++census.counts[StatsCollector::Arrays]; census.enter(); handler.onArrayBegin(); }
+		void onArrayEnd()    { --census.depth; handler.onArrayEnd(); }
+		void onString(Slice s) {
+			++census.counts[StatsCollector::Strings];
+			census.counts[StatsCollector::StringBytes] += s.size;
+			handler.onString(s);
+		}
+		void onNumber(Slice n) { ++census.counts[StatsCollector::Numbers]; handler.onNumber(n); }
+		void onTrue()  { ++census.counts[StatsCollector::Literals]; handler.onTrue(); }
+		void onFalse() { ++census.counts[StatsCollector::Literals]; handler.onFalse(); }
+		void onNull()  { ++census.counts[StatsCollector::Literals]; handler.onNull(); }
+	};
+
+	//*****************************
+	// Hooks used by the library
+	//*****************************
+
+#ifdef JSON_STATS
+	// Adds the time from its construction to a counter, when it is
+	// stopped or destroyed, whichever comes first.
+	class StatsTimer {
+	public:
+		StatsTimer(StatsCollector::Counter c) : counter(c), running(StatsCollector::current() != nullptr) {
+			if(running)
+				start = std::chrono::steady_clock::now();
+		}
+		~StatsTimer() { stop(); }
+
+		void stop() {
+			if(!running)
+				return;
+			running = false;
+			if(StatsCollector* s = StatsCollector::current())	// It may have gone in the meantime.
+				s->add(counter, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						std::chrono::steady_clock::now() - start).count()));
+		}
+	private:
+		StatsCollector::Counter counter;
+		bool running;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	inline void countAllocation() {
+		if(StatsCollector* s = StatsCollector::current())
+			s->add(StatsCollector::Allocations, 1);
+	}
+#else
+	class StatsTimer {
+	public:
+		StatsTimer(StatsCollector::Counter) { }
+		void stop() { }
+	};
+
+	inline void countAllocation() { }
+#endif
+};
+
+#endif
@@ -0,0 +1,600 @@
+// Douglas Keller
+
+#include "tape.hpp"
+#include "reader.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+	using json::Tag;
+	using json::Tape;
+
+	const std::uint64_t positionMask = 0xffffffffu;
+
+	// The position just past the value at i of a tape still being built.
+	std::size_t skip(std::vector<std::uint64_t> const& words, std::size_t i) {
+		Tag t = Tag(words[i] >> 56);
+		if(t == Tag::Object || t == Tag::Array)
+			return std::size_t(words[i] & positionMask) + 1;
+		return i + 1;
+	}
+
+	// Returns a word of a value that is being copied or moved from
+	// position from on a tape to position to. Containers say where
+	// their other end is, so theirs change; nothing else does.
+	std::uint64_t relocate(std::uint64_t word, std::size_t from, std::size_t to) {
+		Tag t = Tag(word >> 56);
+		if(t != Tag::Object && t != Tag::Array && t != Tag::ObjectEnd && t != Tag::ArrayEnd)
+			return word;
+		std::uint64_t position = (word & positionMask) - from + to;
+		return (word & ~positionMask) | position;
+	}
+
+	/*	The TapeBuilder is the Handler that writes parser events onto
+		a tape. A container's first word is written as a placeholder
+		and filled in once its end, and so its size, is known.
+	*/
+	struct TapeBuilder final : json::Handler {
+		struct Open {
+			std::size_t at;
+			std::uint64_t count;
+		};
+
+		std::vector<std::uint64_t>& words;
+		std::string& text;
+		std::vector<Open> open;
+
+		// Scratch space for finding repeated keys in an object.
+		std::vector<std::size_t> members;
+		std::vector<std::uint32_t> slots;
+		std::vector<bool> keep;
+
+		TapeBuilder(std::vector<std::uint64_t>& w, std::string& t) : words(w), text(t) { }
+
+		void value() {
+			if(!open.empty())
+				++open.back().count;
+		}
+		void begin() {
+			value();
+			Open o = { words.size(), 0 };
+			open.push_back(o);
+			words.push_back(0);
+		}
+		void end(Tag first, Tag last) {
+			Open o = open.back();
+			open.pop_back();
+			if(first == Tag::Object)
+				o.count = unique(o.at);
+			std::size_t here = words.size();
+			if(here > positionMask)
+				throw std::length_error("Document is too large for a tape.");
+			words[o.at] = Tape::word(first, std::min(o.count, Tape::countLimit) << 32 | here);
+			words.push_back(Tape::word(last, o.at));
+		}
+		void chars(Tag t, json::Slice s) {
+			if(s.size > positionMask)
+				throw std::length_error("String is too large for a tape.");
+			std::uint32_t size = std::uint32_t(s.size);
+			words.push_back(Tape::word(t, text.size()));
+			text.append(reinterpret_cast<const char*>(&size), sizeof(size));
+			text.append(s.data, s.size);
+		}
+		json::Slice keyAt(std::size_t i) const {
+			std::uint64_t offset = words[i] & ((1ull << 56) - 1);
+			std::uint32_t size;
+			std::memcpy(&size, text.data() + offset, sizeof(size));
+			json::Slice s = { text.data() + offset + sizeof(size), size };
+			return s;
+		}
+
+		std::size_t unique(std::size_t at);
+
+		void onObjectBegin() { begin(); }
+		void onKey(json::Slice key) { chars(Tag::String, key); }
+		void onObjectEnd() { end(Tag::Object, Tag::ObjectEnd); }
+		void onArrayBegin() { begin(); }
+		void onArrayEnd() { end(Tag::Array, Tag::ArrayEnd); }
+		void onString(json::Slice s) { value(); chars(Tag::String, s); }
+		void onNumber(json::Slice s) { value(); chars(Tag::Number, s); }
+		void onTrue()  { value(); words.push_back(Tape::word(Tag::True, 0)); }
+		void onFalse() { value(); words.push_back(Tape::word(Tag::False, 0)); }
+		void onNull()  { value(); words.push_back(Tape::word(Tag::Null, 0)); }
+	};
+
+	// Objects on a tape follow the same rule as Object::assign: when a
+	// key is repeated, only its last member is kept. The object at the
+	// given position has just been read, and is the last thing on the tape.
+	// Postcondition: Returns the number of members the object has left.
+	std::size_t TapeBuilder::unique(std::size_t at) {
+		members.clear();
+		for(std::size_t i = at + 1; i < words.size(); i = skip(words, i + 1))
+			members.push_back(i);
+		std::size_t n = members.size();
+
+		keep.assign(n, true);
+		bool repeated = false;
+		if(n <= 16) {
+			// Small objects are checked by comparing keys directly.
+			for(std::size_t i = 0; i < n; ++i)
+				for(std::size_t j = i + 1; j < n && keep[i]; ++j)
+					if(keyAt(members[i]) == keyAt(members[j]))
+						keep[i] = false, repeated = true;
+		} else {
+			// Large objects are read back to front through a hash table,
+			// so the first time a key is seen is its last occurrence.
+			std::size_t size = 1;
+			while(size < 2 * n)
+				size <<= 1;
+			slots.assign(size, 0);
+			for(std::size_t i = n; i-- > 0;) {
+				json::Slice key = keyAt(members[i]);
+				for(std::size_t s = std::size_t(key.hash()) & (size - 1);; s = (s + 1) & (size - 1)) {
+					if(slots[s] == 0) {
+						slots[s] = std::uint32_t(i + 1);
+						break;
+					}
+					if(keyAt(members[slots[s] - 1]) == key) {
+						keep[i] = false;
+						repeated = true;
+						break;
+					}
+				}
+			}
+		}
+		if(!repeated)
+			return n;
+
+		// Slide the members that are kept over the ones that are not.
+		std::size_t to = at + 1, kept = 0;
+		for(std::size_t i = 0; i < n; ++i) {
+			std::size_t from = members[i];
+			std::size_t last = i + 1 < n ? members[i + 1] : words.size();
+			if(!keep[i])
+				continue;
+			for(std::size_t w = from; w < last; ++w)
+				words[to + w - from] = relocate(words[w], from, to);
+			to += last - from;
+			++kept;
+		}
+		words.resize(to);
+		return kept;
+	}
+
+	// Reports a tree of Values to a handler, as if it were being parsed.
+	// Objects and arrays are kept on a stack rather than recursed into,
+	// like Writer::tree, since set can nest values past maxDepth.
+	void emit(json::Value* root, json::Handler& h) {
+		struct Frame {
+			json::Value* container;
+			std::size_t next;
+		};
+		std::vector<Frame> frames;
+		json::Value* v = root;
+		for(;;) {
+			if(v) {		// Start the next value.
+				switch(v->type) {
+					case json::Type::Object:
+					case json::Type::Array: {
+						if(v->type == json::Type::Object)
+							h.onObjectBegin();
+						else
+							h.onArrayBegin();
+						Frame f = { v, 0 };
+						frames.push_back(f);
+						break;
+					}
+					case json::Type::String: h.onString(static_cast<json::String*>(v)->value); break;
+					case json::Type::Number: h.onNumber(static_cast<json::Number*>(v)->value); break;
+					case json::Type::True:   h.onTrue(); break;
+					case json::Type::False:  h.onFalse(); break;
+					default:                 h.onNull(); break;
+				}
+			}
+			if(frames.empty())
+				return;
+
+			Frame& f = frames.back();
+			if(f.container->type == json::Type::Object) {
+				json::Object* o = static_cast<json::Object*>(f.container);
+				if(f.next == o->size) {
+					h.onObjectEnd();
+					frames.pop_back();
+					v = nullptr;
+					continue;
+				}
+				h.onKey(o->members[f.next].key->text);
+				v = o->members[f.next++].value;
+			} else {
+				json::Array* a = static_cast<json::Array*>(f.container);
+				if(f.next == a->size) {
+					h.onArrayEnd();
+					frames.pop_back();
+					v = nullptr;
+					continue;
+				}
+				v = a->values[f.next++];
+			}
+		}
+	}
+
+	// Hashes the text of strings, so they can be written only once.
+	struct SliceHash {
+		std::size_t operator() (json::Slice const& s) const { return std::size_t(s.hash()); }
+	};
+
+	const char magic[8] = { 'J', 'S', 'O', 'N', 'T', 'A', 'P', 'E' };
+	const std::uint32_t version = 1;
+	const std::uint32_t byteOrder = 0x01020304;
+
+	bool matches(json::Slice key, std::vector<std::string> const& args) {
+		for(std::string const& a : args)
+			if(key == a)
+				return true;
+		return false;
+	}
+
+	// Copies the value at c onto the end of out.
+	void copy(json::Cursor c, Tape const& tape, std::vector<std::uint64_t>& out) {
+		std::size_t from = c.position();
+		std::size_t to = out.size();
+		for(std::size_t w = from; w < c.after(); ++w)
+			out.push_back(relocate(tape.words[w], from, to));
+	}
+
+	// Writes what Document::Filter would return for the value at root
+	// onto the end of out. Open objects and arrays are kept on a stack
+	// rather than recursed into, and each one's first word is written
+	// as a placeholder that is filled in or taken back once it ends.
+	// Postcondition: Returns false, having written nothing, if nothing matched.
+	bool filter(json::Cursor root, Tape const& tape, std::vector<std::string> const& args,
+			std::vector<std::uint64_t>& out) {
+		struct Frame {
+			json::Iterator at;
+			json::Iterator end;
+			Tag type;
+			std::size_t begin;		// Where its first word is on out.
+			std::uint64_t count;	// Members or elements kept.
+			std::size_t mark;		// Where the member or element being filtered starts on out.
+		};
+		std::vector<Frame> frames;
+		json::Cursor c = root;
+		for(;;) {
+			Tag t = c.type();
+			if(t == Tag::Object || t == Tag::Array) {
+				Frame f = { c.begin(), c.end(), t, out.size(), 0, 0 };
+				frames.push_back(f);
+				out.push_back(0);
+			} else if(frames.empty()) {
+				return false;
+			} else {	// Nothing below a string, number or literal can match.
+				out.resize(frames.back().mark);
+			}
+
+			// Find the next member or element to filter, ending objects and arrays on the way.
+			for(;;) {
+				Frame& f = frames.back();
+				if(f.at != f.end) {
+					json::Iterator i = f.at;
+					++f.at;
+					f.mark = out.size();
+					if(f.type == Tag::Object) {
+						out.push_back(tape.words[i.position()]);	// The key.
+						if(matches(i.key(), args)) {
+							copy(*i, tape, out);	// Add the pair as it is.
+							++f.count;
+							continue;
+						}
+					}
+					c = *i;
+					break;
+				}
+
+				Frame done = f;
+				frames.pop_back();
+				bool kept = done.count != 0;
+				if(kept) {
+					if(out.size() > positionMask)
+						throw std::length_error("Document is too large for a tape.");
+					Tag last = done.type == Tag::Object ? Tag::ObjectEnd : Tag::ArrayEnd;
+					out[done.begin] = Tape::word(done.type, std::min(done.count, Tape::countLimit) << 32 | out.size());
+					out.push_back(Tape::word(last, done.begin));
+				} else {	// Only keep a container if something was found in it.
+					out.resize(done.begin);
+				}
+				if(frames.empty())
+					return kept;
+				if(kept)
+					++frames.back().count;
+				else
+					out.resize(frames.back().mark);
+			}
+		}
+	}
+}
+
+const std::uint64_t json::Tape::countLimit;
+const std::size_t json::Tape::headerSize;
+
+//*****************************
+// Cursor member functions
+//*****************************
+
+std::size_t json::Cursor::size() const {
+	std::uint64_t count = tape->payload(at) >> 32;
+	if(count < Tape::countLimit)
+		return std::size_t(count);
+	std::size_t n = 0;	// Too many to have been kept; count them.
+	for(Iterator i = begin(); i != end(); ++i)
+		++n;
+	return n;
+}
+
+//Postcondition: Returns a cursor at the value of the member named key,
+//			or an invalid cursor if there is none.
+json::Cursor json::Cursor::find(Slice key) const {
+	if(type() != Tag::Object)
+		return Cursor();
+	for(Iterator i = begin(); i != end(); ++i)
+		if(i.key() == key)
+			return *i;
+	return Cursor();
+}
+json::Cursor json::Cursor::find(std::string const& key) const {
+	Slice s = { key.data(), key.size() };
+	return find(s);
+}
+
+//Postcondition: Returns a cursor at element n of the array,
+//			or an invalid cursor if there is none.
+json::Cursor json::Cursor::operator[](std::size_t n) const {
+	if(type() != Tag::Array)
+		return Cursor();
+	for(Iterator i = begin(); i != end(); ++i)
+		if(n-- == 0)
+			return *i;
+	return Cursor();
+}
+
+//*****************************
+// Tape member functions
+//*****************************
+
+std::shared_ptr<json::Tape const> json::Tape::parse(const char* data, std::size_t size) {
+	std::shared_ptr<std::vector<std::uint64_t> > words = std::make_shared<std::vector<std::uint64_t> >();
+	std::shared_ptr<std::string> text = std::make_shared<std::string>();
+	// The text is about as long as the input, and values average a few
+	// characters each, so reserving this much saves most of the copying
+	// as the buffers grow.
+	words->reserve(size / 8 + 1);
+	text->reserve(size + size / 4);
+	TapeBuilder b(*words, *text);
+	readWhole(data, size, b);
+	return std::make_shared<Tape>(words->data(), words->size(), text->data(), text->size(), words, text);
+}
+
+//Postcondition: Returns a tape holding the same value as the tree
+//			under root, or an empty tape if root is null.
+std::shared_ptr<json::Tape const> json::Tape::build(Value const* root) {
+	std::shared_ptr<std::vector<std::uint64_t> > words = std::make_shared<std::vector<std::uint64_t> >();
+	std::shared_ptr<std::string> text = std::make_shared<std::string>();
+	if(root) {
+		TapeBuilder b(*words, *text);
+		emit(const_cast<Value*>(root), b);	// Values are only read.
+	}
+	return std::make_shared<Tape>(words->data(), words->size(), text->data(), text->size(), words, text);
+}
+
+std::string json::Tape::serialize() const {
+	// Build the string table first, so its size is known for the header.
+	std::vector<std::uint64_t> out(words, words + length);
+	std::string table;
+	std::unordered_map<Slice, std::uint64_t, SliceHash> offsets;
+	for(std::uint64_t& w : out) {
+		Tag t = Tag(w >> 56);
+		if(t != Tag::String && t != Tag::Number)
+			continue;
+		Slice s = string(std::size_t(&w - out.data()));
+		std::unordered_map<Slice, std::uint64_t, SliceHash>::iterator i = offsets.find(s);
+		if(i == offsets.end()) {
+			i = offsets.insert(std::make_pair(s, std::uint64_t(table.size()))).first;
+			std::uint32_t size = std::uint32_t(s.size);
+			table.append(reinterpret_cast<const char*>(&size), sizeof(size));
+			table.append(s.data, s.size);
+		}
+		w = word(t, i->second);
+	}
+
+	std::uint64_t n = out.size(), tn = table.size();
+	std::string bytes;
+	bytes.reserve(headerSize + n * sizeof(std::uint64_t) + tn);
+	bytes.append(magic, sizeof(magic));
+	bytes.append(reinterpret_cast<const char*>(&version), sizeof(version));
+	bytes.append(reinterpret_cast<const char*>(&byteOrder), sizeof(byteOrder));
+	bytes.append(reinterpret_cast<const char*>(&n), sizeof(n));
+	bytes.append(reinterpret_cast<const char*>(&tn), sizeof(tn));
+	bytes.append(reinterpret_cast<const char*>(out.data()), n * sizeof(std::uint64_t));
+	bytes.append(table);
+	return bytes;
+}
+
+namespace {
+	void corrupt() { throw json::ParseError("binary json is corrupt"); }
+
+	/*	Checks every word of a tape read from bytes that may not have
+		come from serialize, so nothing reading it later can go outside
+		its words or text: each tag is known, each string's length and
+		characters are inside the text, each object or array ends where
+		it says with the end that matches it and holds as many values
+		as it says, each key is a string, and the words hold exactly
+		one value. Throws ParseError if any of them is wrong, or if
+		objects and arrays are nested deeper than maxDepth, like the
+		parsers do, since tapes turned into trees are walked by recursion.
+	*/
+	void validate(const std::uint64_t* words, std::size_t n, std::size_t textSize, const char* text) {
+		struct Open {
+			std::size_t at;
+			std::size_t end;
+			std::uint64_t children;	// Values in it so far, keys included.
+			bool object;
+		};
+		std::vector<Open> open;
+		std::size_t limit = json::maxDepth();
+		for(std::size_t i = 0; i < n; ++i) {
+			Tag t = Tag(words[i] >> 56);
+			std::uint64_t payload = words[i] & ((1ull << 56) - 1);
+
+			if(t == Tag::ObjectEnd || t == Tag::ArrayEnd) {
+				if(open.empty() || open.back().end != i || payload != open.back().at
+						|| (t == Tag::ObjectEnd) != open.back().object)
+					corrupt();
+				Open o = open.back();
+				open.pop_back();
+				std::uint64_t count = o.object ? o.children / 2 : o.children;
+				if((o.object && o.children % 2)
+						|| (words[o.at] & ((1ull << 56) - 1)) >> 32 != std::min(count, Tape::countLimit))
+					corrupt();
+			} else {
+				if(i && open.empty())	// Something after the top value.
+					corrupt();
+				if(!open.empty()) {
+					Open& parent = open.back();
+					if(parent.object && parent.children % 2 == 0 && t != Tag::String)
+						corrupt();	// Keys must be strings.
+					++parent.children;
+				}
+				switch(t) {
+					case Tag::Object:
+					case Tag::Array: {
+						Open o = { i, std::size_t(payload & positionMask), 0, t == Tag::Object };
+						if(o.end <= i || o.end >= n)
+							corrupt();
+						if(open.size() >= limit)
+							throw json::ParseError("nested too deeply");
+						open.push_back(o);
+						break;
+					}
+					case Tag::String:
+					case Tag::Number: {
+						std::uint32_t size;
+						if(payload > textSize || textSize - payload < sizeof(size))
+							corrupt();
+						std::memcpy(&size, text + payload, sizeof(size));
+						if(textSize - payload - sizeof(size) < size)
+							corrupt();
+						break;
+					}
+					case Tag::True:
+					case Tag::False:
+					case Tag::Null:
+						break;
+					default:
+						corrupt();
+				}
+			}
+		}
+		if(!open.empty())
+			corrupt();
+	}
+}
+
+std::shared_ptr<json::Tape const> json::Tape::deserialize(const char* data, std::size_t size,
+		std::shared_ptr<void const> owner) {
+	std::uint32_t v, order;
+	std::uint64_t n, tn;
+	if(size < headerSize || std::memcmp(data, magic, sizeof(magic)) != 0)
+		throw ParseError("not a binary json document");
+	std::memcpy(&v, data + 8, sizeof(v));
+	std::memcpy(&order, data + 12, sizeof(order));
+	std::memcpy(&n, data + 16, sizeof(n));
+	std::memcpy(&tn, data + 24, sizeof(tn));
+	if(v != version)
+		throw ParseError("unknown binary json version");
+	if(order != byteOrder)
+		throw ParseError("binary json was written with a different byte order");
+	if(n > (size - headerSize) / sizeof(std::uint64_t) || tn != size - headerSize - n * sizeof(std::uint64_t))
+		throw ParseError("binary json is the wrong size");
+
+	const char* w = data + headerSize;
+	const char* text = w + n * sizeof(std::uint64_t);
+	const std::uint64_t* aligned = reinterpret_cast<const std::uint64_t*>(w);
+	std::shared_ptr<void const> wordOwner = owner;
+	if(reinterpret_cast<std::uintptr_t>(w) % alignof(std::uint64_t) != 0) {
+		// Words can only be read in place if they are aligned, which
+		// they always are in a mapped file, but may not be elsewhere.
+		std::shared_ptr<std::vector<std::uint64_t> > copy = std::make_shared<std::vector<std::uint64_t> >(std::size_t(n));
+		std::memcpy(copy->data(), w, std::size_t(n) * sizeof(std::uint64_t));
+		aligned = copy->data();
+		wordOwner = copy;
+	}
+	validate(aligned, std::size_t(n), std::size_t(tn), text);
+	return std::make_shared<Tape>(aligned, std::size_t(n), text, std::size_t(tn), wordOwner, owner);
+}
+
+// Recursive method that reports the value at c and everything in it.
+// Open objects and arrays are kept on a stack, like Writer::tape,
+// since a tape built from a tree can be nested past maxDepth.
+void json::Tape::replay(Cursor root, Handler& h) const {
+	struct Frame {
+		Iterator at;
+		Iterator end;
+		bool object;
+	};
+	std::vector<Frame> frames;
+	Cursor c = root;
+	bool start = true;
+	for(;;) {
+		if(start) {
+			switch(c.type()) {
+				case Tag::Object:
+				case Tag::Array: {
+					bool object = c.type() == Tag::Object;
+					if(object)
+						h.onObjectBegin();
+					else
+						h.onArrayBegin();
+					Frame f = { c.begin(), c.end(), object };
+					frames.push_back(f);
+					break;
+				}
+				case Tag::String: h.onString(c.text()); break;
+				case Tag::Number: h.onNumber(c.text()); break;
+				case Tag::True:   h.onTrue(); break;
+				case Tag::False:  h.onFalse(); break;
+				default:          h.onNull(); break;
+			}
+		}
+		if(frames.empty())
+			return;
+
+		Frame& f = frames.back();
+		if(f.at == f.end) {
+			if(f.object)
+				h.onObjectEnd();
+			else
+				h.onArrayEnd();
+			frames.pop_back();
+			start = false;
+			continue;
+		}
+		if(f.object)
+			h.onKey(f.at.key());
+		c = *f.at;
+		++f.at;
+		start = true;
+	}
+}
+
+std::shared_ptr<json::Tape const> json::Tape::filter(std::vector<std::string> const& args) const {
+	std::shared_ptr<std::vector<std::uint64_t> > out = std::make_shared<std::vector<std::uint64_t> >();
+	if(!length || !::filter(root(), *this, args, *out))
+		return nullptr;
+	return std::make_shared<Tape>(out->data(), out->size(), text, textSize, out, textOwner);
+}
+
+std::shared_ptr<json::Tape const> json::Tape::clone() const {
+	std::shared_ptr<std::vector<std::uint64_t> > w = std::make_shared<std::vector<std::uint64_t> >(words, words + length);
+	std::shared_ptr<std::string> t = std::make_shared<std::string>(text, textSize);
+	return std::make_shared<Tape>(w->data(), w->size(), t->data(), t->size(), w, t);
+}
@@ -0,0 +1,203 @@
+// Douglas Keller
+
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include "json.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+
+namespace json {
+
+	/*	A Tape is a whole json value laid out flat, as an array of
+		64 bit words in the order the value was read, plus one buffer
+		holding the text of every string and number. Nothing on it is
+		a separate allocation or has a vtable, and reading it in order
+		only ever moves forward through memory.
+
+		Each word holds a tag in its top 8 bits and a payload below:
+			{ [     (count << 32) | position of the matching } or ]
+			} ]     position of the matching { or [
+			" n     offset of the text: a 4 byte length, then the characters
+			t f N   nothing
+		An object's words are its keys, each followed by its value.
+		Since every container knows where it ends, a whole value can be
+		stepped over without looking inside it.
+
+		A Tape does not care where its words and text are kept; it only
+		keeps the owners of that memory alive. Filtered tapes share the
+		text of the tape they came from this way.
+	*/
+	enum class Tag : std::uint8_t {
+		Object = '{', ObjectEnd = '}', Array = '[', ArrayEnd = ']',
+		String = '\"', Number = 'n', True = 't', False = 'f', Null = 'N'
+	};
+
+	class Cursor;
+	class Tape;
+
+	// Steps through the elements of an array or the members of an object.
+	class Iterator {
+	public:
+		Iterator(Tape const* t, std::size_t a, bool o) : tape(t), at(a), object(o) { }
+
+		// The element, or the value of the member.
+		Cursor operator* () const;
+		// The key of the member; only for objects.
+		Slice key() const;
+		// Where the element, or the key of the member, is on the tape.
+		std::size_t position() const { return at; }
+		Iterator& operator++ ();
+
+		bool operator== (Iterator const& i) const { return at == i.at; }
+		bool operator!= (Iterator const& i) const { return at != i.at; }
+
+	private:
+		Tape const* tape;
+		std::size_t at;		// The element, or the key of the member.
+		bool object;
+	};
+
+	// Points at a single value on a Tape. A default Cursor points
+	// at nothing, which is what lookups return when they fail.
+	class Cursor {
+	public:
+		Cursor() : tape(nullptr), at(0) { }
+		Cursor(Tape const* t, std::size_t a) : tape(t), at(a) { }
+
+		bool valid() const { return tape != nullptr; }
+		Tag type() const;
+		std::size_t position() const { return at; }
+		// The position just past this value, found without walking it.
+		std::size_t after() const;
+
+		// The text of a string or number, as it was written.
+		Slice text() const;
+		// The number of members or elements of an object or array.
+		std::size_t size() const;
+
+		Iterator begin() const;
+		Iterator end() const;
+		// The value of an object's member, or an invalid cursor.
+		Cursor find(Slice key) const;
+		Cursor find(std::string const& key) const;
+		// An array's element; elements before it are skipped, not read.
+		Cursor operator[] (std::size_t) const;
+
+	private:
+		Tape const* tape;
+		std::size_t at;
+	};
+
+	class Tape {
+	public:
+		// Counts of 2^24 or more are not kept, and are walked instead.
+		static const std::uint64_t countLimit = (1ull << 24) - 1;
+
+		Tape(const std::uint64_t* w, std::size_t n, const char* t, std::size_t tn,
+				std::shared_ptr<void const> wo, std::shared_ptr<void const> to)
+			: words(w), length(n), text(t), textSize(tn), wordOwner(wo), textOwner(to) { }
+
+		Tape(Tape const&) = delete;
+		Tape& operator= (Tape const&) = delete;
+
+		const std::uint64_t* words;
+		std::size_t length;
+		const char* text;
+		std::size_t textSize;
+
+		// The top value; an empty tape has none.
+		Cursor root() const { return Cursor(this, 0); }
+
+		static std::uint64_t word(Tag t, std::uint64_t payload) {
+			return std::uint64_t(t) << 56 | payload;
+		}
+		Tag tag(std::size_t i) const { return Tag(words[i] >> 56); }
+		std::uint64_t payload(std::size_t i) const { return words[i] & ((1ull << 56) - 1); }
+		Slice string(std::size_t i) const {
+			std::uint64_t offset = payload(i);
+			std::uint32_t size;
+			std::memcpy(&size, text + offset, sizeof(size));
+			Slice s = { text + offset + sizeof(size), size };
+			return s;
+		}
+
+		// Reports the value at c to a handler, as if it were being parsed.
+		void replay(Cursor c, Handler&) const;
+		// Returns a tape that keeps only the parts of this one that
+		// Document::filter would, and shares this tape's text.
+		// Returns nullptr if nothing matches.
+		std::shared_ptr<Tape const> filter(std::vector<std::string> const& args) const;
+		// Returns a tape with its own copy of this one's words and text.
+		std::shared_ptr<Tape const> clone() const;
+
+		// Parses a complete value into a new tape.
+		// Throws ParseError if the characters are not a complete json value.
+		static std::shared_ptr<Tape const> parse(const char*, std::size_t);
+		// Lays a tree of Values out on a new tape.
+		static std::shared_ptr<Tape const> build(Value const*);
+
+		/*	The binary form of a tape is a 32 byte header, then the
+			words, then the text, so a tape can be used straight from
+			the bytes of a file without reading any of it first:
+				8 bytes  "JSONTAPE"
+				4 bytes  the format version, 1
+				4 bytes  0x01020304, to catch files from machines with
+				         a different byte order
+				8 bytes  the number of words
+				8 bytes  the size of the text
+			Every distinct string or number is only written once, and
+			the words that use it all point at the same text.
+		*/
+		std::string serialize() const;
+		// Returns a tape that reads its words and text from the bytes of
+		// serialize, which owner keeps alive. Words that are not 8 byte
+		// aligned are copied. Every word is checked in one pass, much
+		// quicker than parsing, and ParseError is thrown if the header,
+		// the sizes or any word is not something serialize could write.
+		static std::shared_ptr<Tape const> deserialize(const char*, std::size_t, std::shared_ptr<void const> owner);
+		static const std::size_t headerSize = 32;
+
+	private:
+		std::shared_ptr<void const> wordOwner;
+		std::shared_ptr<void const> textOwner;
+	};
+
+	//*****************************
+	// Cursor and Iterator functions
+	//*****************************
+
+	inline Tag Cursor::type() const {
+		return tape->tag(at);
+	}
+	inline std::size_t Cursor::after() const {
+		Tag t = tape->tag(at);
+		if(t == Tag::Object || t == Tag::Array)
+			return std::size_t(tape->payload(at) & 0xffffffffu) + 1;
+		return at + 1;
+	}
+	inline Slice Cursor::text() const {
+		return tape->string(at);
+	}
+	inline Iterator Cursor::begin() const {
+		return Iterator(tape, at + 1, type() == Tag::Object);
+	}
+	inline Iterator Cursor::end() const {
+		return Iterator(tape, after() - 1, type() == Tag::Object);
+	}
+
+	inline Cursor Iterator::operator* () const {
+		return Cursor(tape, object ? at + 1 : at);
+	}
+	inline Slice Iterator::key() const {
+		return tape->string(at);
+	}
+	inline Iterator& Iterator::operator++ () {
+		at = (**this).after();
+		return *this;
+	}
+};
+
+#endif
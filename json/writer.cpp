@@ -0,0 +1,368 @@
+// Douglas Keller
+
+#include "writer.hpp"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+#include <unistd.h>
+
+namespace {
+	// How much output is collected before it is sent to a sink.
+	const std::size_t chunkSize = 1 << 16;
+
+	// Enough spaces to indent one line of pretty output in a single copy.
+	const char spaces[] = "                                                                ";
+
+	// The Measurer adds up the number of characters a Writer will
+	// produce for a value without producing any of them. Every value
+	// adds the same amount however it is reached, so values are taken
+	// off a stack in any order, along with how deeply they are nested.
+	struct Measurer {
+		json::Format format;
+		std::size_t size;
+
+		Measurer(json::Format f) : format(f), size(0) { }
+
+		// The characters around the n values of an object or array
+		// nested tab deep: its braces, the commas between values, and
+		// for pretty output the line breaks and indentation.
+		void container(std::size_t n, std::size_t tab) {
+			switch(format) {
+				case json::Format::Pretty:
+					size += 2 + n * 2 * (tab + 1) + (n ? 2 * (n - 1) : 0) + 1 + 2 * tab + 1;
+					break;
+				case json::Format::Spaced:
+					size += 2 + (n ? 2 * (n - 1) : 0);
+					break;
+				case json::Format::Minified:
+					size += 2 + (n ? n - 1 : 0);
+					break;
+			}
+		}
+		std::size_t colon() const { return format == json::Format::Minified ? 1 : 2; }
+
+		void tree(json::Value* root) {
+			std::vector<std::pair<json::Value*, std::size_t> > stack(1, std::make_pair(root, std::size_t(0)));
+			while(!stack.empty()) {
+				json::Value* v = stack.back().first;
+				std::size_t tab = stack.back().second;
+				stack.pop_back();
+				switch(v->type) {
+					case json::Type::Object: {
+						json::Object* o = static_cast<json::Object*>(v);
+						container(o->size, tab);
+						for(std::size_t i = 0; i < o->size; ++i) {
+							size += o->members[i].key->text.size + 2 + colon();
+							stack.push_back(std::make_pair(o->members[i].value, tab + 1));
+						}
+						break;
+					}
+					case json::Type::Array: {
+						json::Array* a = static_cast<json::Array*>(v);
+						container(a->size, tab);
+						for(std::size_t i = 0; i < a->size; ++i)
+							stack.push_back(std::make_pair(a->values[i], tab + 1));
+						break;
+					}
+					case json::Type::String: size += static_cast<json::String*>(v)->value.size + 2; break;
+					case json::Type::Number: size += static_cast<json::Number*>(v)->value.size; break;
+					case json::Type::False:  size += 5; break;
+					default:                 size += 4; break;
+				}
+			}
+		}
+
+		// The same count for a value on a tape.
+		void tape(json::Cursor root) {
+			std::vector<std::pair<json::Cursor, std::size_t> > stack(1, std::make_pair(root, std::size_t(0)));
+			while(!stack.empty()) {
+				json::Cursor c = stack.back().first;
+				std::size_t tab = stack.back().second;
+				stack.pop_back();
+				switch(c.type()) {
+					case json::Tag::Object:
+					case json::Tag::Array: {
+						bool object = c.type() == json::Tag::Object;
+						container(c.size(), tab);
+						for(json::Iterator i = c.begin(); i != c.end(); ++i) {
+							if(object)
+								size += i.key().size + 2 + colon();
+							stack.push_back(std::make_pair(*i, tab + 1));
+						}
+						break;
+					}
+					case json::Tag::String: size += c.text().size + 2; break;
+					case json::Tag::Number: size += c.text().size; break;
+					case json::Tag::False:  size += 5; break;
+					default:                size += 4; break;
+				}
+			}
+		}
+	};
+}
+
+//*****************************
+// Writer member functions
+//*****************************
+
+json::Writer::Writer(Format f)
+	: format(f), os(nullptr), fd(-1), cur(&text[0]), end(cur), tab(0) { }
+
+json::Writer::Writer(Format f, std::ostream& o)
+	: format(f), os(&o), fd(-1), chunk(chunkSize), cur(chunk.data()), end(cur + chunk.size()), tab(0) { }
+
+// A negative descriptor would be taken for having no sink at all,
+// and the output quietly kept in the string instead.
+json::Writer::Writer(Format f, int d)
+	: format(f), os(nullptr), fd(d), chunk(chunkSize), cur(chunk.data()), end(cur + chunk.size()), tab(0) {
+	if(d < 0)
+		throw std::invalid_argument("Invalid file descriptor.");
+}
+
+// Postcondition: The value has been added to the output.
+void json::Writer::write(Value* v) {
+	if(!os && fd < 0)	// Size a string once, so it never has to be copied as it grows.
+		reserve(measure(v, format));
+	tab = 0;
+	tree(v);
+}
+
+// Postcondition: The value at c on its tape has been added to the output.
+void json::Writer::write(Cursor c) {
+	if(!os && fd < 0)
+		reserve(measure(c, format));
+	tab = 0;
+	tape(c);
+}
+
+std::size_t json::Writer::measure(Value* v, Format f) {
+	Measurer m(f);
+	m.tree(v);
+	return m.size;
+}
+std::size_t json::Writer::measure(Cursor c, Format f) {
+	Measurer m(f);
+	m.tape(c);
+	return m.size;
+}
+
+// Postcondition: Everything written so far has been sent to the sink,
+//			or for a string, the string holds exactly what was written.
+void json::Writer::flush() {
+	if(os) {
+		os->write(chunk.data(), std::streamsize(cur - chunk.data()));
+		cur = chunk.data();
+	} else if(fd >= 0) {
+		const char* p = chunk.data();
+		while(p != cur) {
+			ssize_t n = ::write(fd, p, std::size_t(cur - p));
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n < 0)
+				throw std::runtime_error("Unable to write output.");
+			p += n;
+		}
+		cur = chunk.data();
+	} else {
+		text.resize(std::size_t(cur - &text[0]));
+		cur = end = &text[0] + text.size();
+	}
+}
+
+std::string json::Writer::take() {
+	flush();
+	std::string s;
+	s.swap(text);
+	cur = end = &text[0];
+	return s;
+}
+
+// Postcondition: There is room for at least n more characters at cur.
+void json::Writer::reserve(std::size_t n) {
+	if(std::size_t(end - cur) >= n)
+		return;
+	if(os || fd >= 0) {
+		flush();
+		if(chunk.size() < n)
+			chunk.resize(n);
+		cur = chunk.data();
+		end = cur + chunk.size();
+	} else {
+		std::size_t used = std::size_t(cur - &text[0]);
+		text.resize(std::max(2 * text.size(), used + n));
+		cur = &text[0] + used;
+		end = &text[0] + text.size();
+	}
+}
+
+void json::Writer::put(const char* s, std::size_t n) {
+	reserve(n);
+	std::memcpy(cur, s, n);
+	cur += n;
+}
+
+// Ends a line of pretty output and indents the next one
+// with two spaces for each open object or array.
+void json::Writer::newline() {
+	put('\n');
+	std::size_t n = 2 * std::size_t(tab);
+	while(n > sizeof(spaces) - 1) {
+		put(spaces, sizeof(spaces) - 1);
+		n -= sizeof(spaces) - 1;
+	}
+	put(spaces, n);
+}
+
+// Starts an object or array.
+void json::Writer::open(char c) {
+	put(c);
+	if(format == Format::Pretty)
+		++tab;
+}
+// Separates member or element i from the one before it.
+void json::Writer::item(std::size_t i) {
+	if(i)
+		put(',');
+	if(format == Format::Pretty)
+		newline();
+	else if(i && format == Format::Spaced)
+		put(' ');
+}
+// The key, its quotes and the colon go in a single step.
+void json::Writer::key(Slice k) {
+	reserve(k.size + 4);
+	*cur++ = '\"';
+	std::memcpy(cur, k.data, k.size);
+	cur += k.size;
+	*cur++ = '\"';
+	*cur++ = ':';
+	if(format != Format::Minified)
+		*cur++ = ' ';
+}
+// Ends an object or array.
+void json::Writer::close(char c, bool empty) {
+	if(format == Format::Pretty) {
+		if(empty)	// Empty objects and arrays still take up a blank line.
+			put('\n');
+		--tab;
+		newline();
+	}
+	put(c);
+}
+void json::Writer::quoted(Slice s) {
+	reserve(s.size + 2);
+	*cur++ = '\"';
+	std::memcpy(cur, s.data, s.size);
+	cur += s.size;
+	*cur++ = '\"';
+}
+
+void json::Writer::leaf(Value* v) {
+	switch(v->type) {
+		case Type::String: quoted(static_cast<String*>(v)->value); break;
+		case Type::Number: put(static_cast<Number*>(v)->value); break;
+		case Type::True:   put("true", 4); break;
+		case Type::False:  put("false", 5); break;
+		default:           put("null", 4); break;
+	}
+}
+void json::Writer::leaf(Cursor c) {
+	switch(c.type()) {
+		case Tag::String: quoted(c.text()); break;
+		case Tag::Number: put(c.text()); break;
+		case Tag::True:   put("true", 4); break;
+		case Tag::False:  put("false", 5); break;
+		default:          put("null", 4); break;
+	}
+}
+
+// Writes a tree of values. Each open object or array keeps its
+// place on the stack while the values inside it are written.
+void json::Writer::tree(Value* root) {
+	struct Frame {
+		Value* container;
+		std::size_t next;
+	};
+	std::vector<Frame> frames;
+	Value* v = root;
+	for(;;) {
+		if(v) {		// Start the next value.
+			if(v->type == Type::Object || v->type == Type::Array) {
+				open(v->type == Type::Object ? '{' : '[');
+				Frame f = { v, 0 };
+				frames.push_back(f);
+			} else {
+				leaf(v);
+			}
+		}
+		if(frames.empty())
+			return;
+
+		Frame& f = frames.back();
+		if(f.container->type == Type::Object) {
+			Object* o = static_cast<Object*>(f.container);
+			if(f.next == o->size) {
+				close('}', !o->size);
+				frames.pop_back();
+				v = nullptr;
+				continue;
+			}
+			item(f.next);
+			key(o->members[f.next].key->text);
+			v = o->members[f.next++].value;
+		} else {
+			Array* a = static_cast<Array*>(f.container);
+			if(f.next == a->size) {
+				close(']', !a->size);
+				frames.pop_back();
+				v = nullptr;
+				continue;
+			}
+			item(f.next);
+			v = a->values[f.next++];
+		}
+	}
+}
+
+// The same for the value at c on its tape.
+void json::Writer::tape(Cursor root) {
+	struct Frame {
+		Iterator at;
+		Iterator end;
+		bool object;
+		std::size_t n;
+	};
+	std::vector<Frame> frames;
+	Cursor c = root;
+	bool start = true;
+	for(;;) {
+		if(start) {
+			Tag t = c.type();
+			if(t == Tag::Object || t == Tag::Array) {
+				open(t == Tag::Object ? '{' : '[');
+				Frame f = { c.begin(), c.end(), t == Tag::Object, 0 };
+				frames.push_back(f);
+			} else {
+				leaf(c);
+			}
+		}
+		if(frames.empty())
+			return;
+
+		Frame& f = frames.back();
+		if(f.at == f.end) {
+			close(f.object ? '}' : ']', f.n == 0);
+			frames.pop_back();
+			start = false;
+			continue;
+		}
+		item(f.n++);
+		if(f.object)
+			key(f.at.key());
+		c = *f.at;
+		++f.at;
+		start = true;
+	}
+}
@@ -0,0 +1,80 @@
+// Douglas Keller
+
+#ifndef WRITER_HPP
+#define WRITER_HPP
+
+#include "json.hpp"
+#include "tape.hpp"
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace json {
+
+	/*	The Writer serializes values into a single buffer. When it
+		is given an ostream or a file descriptor, the buffer is
+		flushed there each time it fills, so output of any size
+		needs only a fixed amount of memory. Otherwise the buffer
+		is sized up front to fit the whole value and returned as
+		a string.
+		Output to an ostream or file descriptor is only complete once
+		flush has been called. The destructor does not flush, so that
+		an error writing the last piece reaches the caller rather than
+		escaping a destructor.
+
+		Objects and arrays are written from an explicit stack rather
+		than by recursion, so any depth of nesting can be written.
+	*/
+	class Writer {
+	public:
+		// Writes into a string, which take() returns.
+		Writer(Format);
+		// Writes to the ostream or file descriptor in chunks.
+		// Throws std::invalid_argument if fd is negative.
+		Writer(Format, std::ostream&);
+		Writer(Format, int fd);
+
+		Writer(Writer const&) = delete;
+		Writer& operator= (Writer const&) = delete;
+
+		void write(Value*);
+		void write(Cursor);
+		// Throws std::runtime_error if the file descriptor cannot be written.
+		void flush();
+		// Returns everything written into the string so far, and empties it.
+		std::string take();
+
+		// The exact number of characters write will produce for the value.
+		static std::size_t measure(Value*, Format);
+		static std::size_t measure(Cursor, Format);
+
+	private:
+		Format format;
+		std::ostream* os;
+		int fd;
+		std::string text;			// The whole output, when there is no sink.
+		std::vector<char> chunk;	// The next piece of output, when there is one.
+		char* cur;
+		char* end;
+		int tab;
+
+		void reserve(std::size_t);
+		void put(char c) { reserve(1); *cur++ = c; }
+		void put(const char* s, std::size_t n);
+		void put(Slice s) { put(s.data, s.size); }
+		void newline();
+
+		// The pieces of an object or array, shared by values and tapes.
+		void open(char);
+		void item(std::size_t);
+		void key(Slice);
+		void close(char, bool empty);
+		void quoted(Slice);
+		void leaf(Value*);
+		void leaf(Cursor);
+		void tree(Value*);
+		void tape(Cursor);
+	};
+};
+
+#endif